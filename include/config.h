@@ -8,13 +8,65 @@
 #define GC_PORT 443
 #define GC_USER ENV_GRAFANA_USER
 #define GC_PASS ENV_GRAFANA_PASSWORD
+// Remote Write protocol version (1 or 2). Version 2 falls back to 1 if the endpoint does not support it.
+// Stays at 1 until Remote Write 2.0 is confirmed for the Grafana Cloud stack
+#define GC_REMOTE_WRITE_VERSION 1
+
+// Optional second endpoint receiving the same metrics, e.g. an on-prem Mimir.
+// Set ONPREM_CA to a root certificate for HTTPS or nullptr for plain HTTP, ONPREM_USER to nullptr to send without authentication
+#define ONPREM_ENABLED false
+#define ONPREM_URL "mimir.local"
+#define ONPREM_PATH "/api/v1/push"
+#define ONPREM_PORT 8080
+#define ONPREM_CA nullptr
+#define ONPREM_USER nullptr
+#define ONPREM_PASS nullptr
+#define ONPREM_REMOTE_WRITE_VERSION 1
+
+// Every endpoint queues up to this many pushes and retries failed ones with exponential backoff
+#define REMOTE_WRITE_QUEUE_LENGTH 4
+#define REMOTE_WRITE_MAX_RETRIES 3
+#define REMOTE_WRITE_RETRY_BACKOFF_MS 2000
+#define REMOTE_WRITE_MAX_BACKOFF_MS 30000
+#define REMOTE_WRITE_RESPONSE_TIMEOUT_MS 10000
+
+// Symbol table size of Remote Write 2.0 requests. The request buffer is sized from the registered series
+#define REMOTE_WRITE_V2_MAX_SYMBOLS 128
+// The Remote Write buffers are only allocated while a push is encoded: the request buffer (about 22 KB for the
+// default series, see tools/remote_write_size), the snappy state and a compression buffer sized for the request.
+// In steady state only the compressed payloads waiting in the endpoint queues stay on the heap, about 2 KB per push
+
+// Timeouts in milliseconds for reconnecting to the last access point and for a full scan
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000
+#define WIFI_CONNECT_TIMEOUT_MS 15000
+// Reuse the last IP lease on fast reconnects to skip DHCP
+#define WIFI_FAST_CONNECT_STATIC_IP true
+// Seconds after the DHCP handout for which the lease is reused, keep it below the lease time of the network
+#define WIFI_FAST_CONNECT_LEASE_SECONDS 3600
+// Interval in seconds to update the Wifi status LED if no Wifi event occurs
+#define WIFI_STATUS_CHECK_INTERVAL_SECONDS 30
+// Delay before retrying a failed Wifi reconnect, doubled on every further failure up to WIFI_STATUS_CHECK_INTERVAL_SECONDS
+#define WIFI_RECONNECT_RETRY_MS 1000
 
 // enable temperature and humidity sensor
 #define ENABLE_REV2_SENSORS ENV_ENABLE_REV2_SENSORS
 
 // Enable debug logging to serial
 #define DEBUG true
-#define SERIAL_BAUD MONITOR_SPEED
+
+// Log levels, log calls above LOG_LEVEL are not compiled in
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL (DEBUG ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO)
+// Number of buffered log messages (power of two), messages logged while the buffer is full are dropped
+#define LOG_BUFFER_RECORDS 64
+// Maximum length of a formatted log line
+#define LOG_LINE_LENGTH 160
+// Interval of the task writing buffered log messages to serial
+#define LOG_DRAIN_INTERVAL_MS 50
+#define SERIAL_BAUD (ENABLE_TELEMETRY ? TELEMETRY_BAUD : MONITOR_SPEED)
 
 // Interval in seconds between sending metrics to Grafana Cloud
 #define REMOTE_WRITE_INTERVAL_SECONDS 180
@@ -33,6 +85,12 @@
 
 // Pin to which the vibration sensor is connected
 #define VIBRATION_SENSOR_PIN 36
+// Interval in milliseconds at which the vibration sensor is polled
+#define VIBRATION_POLL_INTERVAL_MS 50
+
+// Print every vibration sensor edge as "VR <ms> <level>" to serial, to be replayed with tools/vibration_replay
+#define ENABLE_VIBRATION_RECORDING false
+
 // Pin connected to a LED to indicated that vibration is detected
 #define VIBRATION_DETECTION_LED_VCC 25
 
@@ -45,6 +103,53 @@
 // The number samples all time series can hold
 #define TIME_SERIES_SAMPLE_COUNT 10
 
+// Record task, semaphore, GPIO and send events into a ring buffer that can be dumped over serial by sending 't'
+#define ENABLE_TRACE false
+// Number of 12 byte records the trace ring buffer can hold
+#define TRACE_BUFFER_RECORDS 512
+// Number of record calls timed on every dump to report the recording overhead
+#define TRACE_COST_MEASURE_RECORDS 1000
+
+// Stream histogram values, gauge samples and events as binary frames over serial, decoded by tools/telemetry_decoder.py.
+// Log lines are sent as text frames, so the plain serial monitor shows no readable output while enabled
+#define ENABLE_TELEMETRY false
+// The CP2102N supports up to 3 Mbaud, 921600 works with every host driver
+#define TELEMETRY_BAUD 921600
+// Number of 16 byte records queued for the telemetry task, records are dropped while the queue is full
+#define TELEMETRY_QUEUE_LENGTH 128
+// Maximum number of histogram and gauge names, and the interval at which they are sent again
+#define TELEMETRY_MAX_NAMES 32
+#define TELEMETRY_NAMES_INTERVAL_MS 5000
+// Maximum length of a text frame, longer lines are split
+#define TELEMETRY_MAX_TEXT 200
+
+// Sliding window over which the brew duration quantiles are calculated, split into slices that expire one at a time
+#define BREW_DURATION_WINDOW_SECONDS 3600
+#define BREW_DURATION_WINDOW_SLICES 6
+// t-digest compression of the brew duration summary. Memory per slice is about 16 bytes * compression
+#define BREW_DURATION_COMPRESSION 50
+
+// Interval in milliseconds at which aggregated gauges (heap, RSSI, CPU temperature) are sampled between ingestions
+#define GAUGE_SAMPLING_INTERVAL_MS 1000
+
+// Memory pressure stages, entered when free heap or the largest free heap block drops below the thresholds in bytes.
+// A TLS handshake needs about 40 KB of heap, the compressed Remote Write payload a few KB in one block
+#define MEMORY_STAGE_QUIET_FREE_HEAP_BYTES 80000
+#define MEMORY_STAGE_QUIET_LARGEST_BLOCK_BYTES 48000
+#define MEMORY_STAGE_SLOW_SAMPLING_FREE_HEAP_BYTES 64000
+#define MEMORY_STAGE_SLOW_SAMPLING_LARGEST_BLOCK_BYTES 40000
+#define MEMORY_STAGE_SHED_FREE_HEAP_BYTES 52000
+#define MEMORY_STAGE_SHED_LARGEST_BLOCK_BYTES 32000
+#define MEMORY_STAGE_FLUSH_FREE_HEAP_BYTES 44000
+#define MEMORY_STAGE_FLUSH_LARGEST_BLOCK_BYTES 24000
+// Headroom above the thresholds required to leave a stage
+#define MEMORY_GOVERNOR_HYSTERESIS_BYTES 4096
+// Factor by which the gauge sampling interval is increased from MEMORY_STAGE_SLOW_SAMPLING on
+#define MEMORY_GOVERNOR_SAMPLING_DIVIDER 5
+
+// Maximum number of gauges and histograms the metric registry can hold
+#define METRIC_REGISTRY_CAPACITY 16
+
 // Pins used for the I2C bus
 #define WIRE_PIN_SDA 32
 #define WIRE_PIN_SCL 33
\ No newline at end of file
@@ -0,0 +1,108 @@
+#ifndef LOG_INCLUDED
+#define LOG_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <type_traits>
+
+// Log calls above LOG_LEVEL compile to nothing. Enabled calls store the format string pointer and the raw
+// arguments in a lock-free ring buffer, which a low priority task formats and writes to serial.
+// Formats use printf conversions, length modifiers are not needed. %u, %x, %X and %o print integers with the
+// width they were logged with, %p takes any pointer. Unsupported conversions, e.g. %n, are printed as they are.
+// Arguments for %s must be string literals or strings that live as long as the firmware, e.g. metric names,
+// because they are only read when drained.
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) Log::write(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+#define LOG_ERROR(format, ...) do { } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) Log::write(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...) do { } while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) Log::write(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+#define LOG_DEBUG(format, ...) do { } while (0)
+#endif
+
+#define LOG_MAX_ARGS 4
+
+enum LogArgType : uint8_t
+{
+    LOG_ARG_INT = 0,
+    LOG_ARG_DOUBLE = 1,
+    LOG_ARG_STRING = 2,
+    LOG_ARG_POINTER = 3
+};
+
+struct LogArg
+{
+    LogArgType type;
+    uint8_t size; // bytes of an integer argument before it was widened to int64_t
+    union
+    {
+        int64_t i;
+        double d;
+        const char *s;
+        const void *p;
+    };
+
+    LogArg() : type(LOG_ARG_INT), size(sizeof(int64_t)), i(0) {}
+    LogArg(double value) : type(LOG_ARG_DOUBLE), size(sizeof(double)), d(value) {}
+    LogArg(const char *value) : type(LOG_ARG_STRING), size(sizeof(const char *)), s(value) {}
+    LogArg(const void *value) : type(LOG_ARG_POINTER), size(sizeof(const void *)), p(value) {}
+    template <typename T, typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, int>::type = 0>
+    LogArg(T value) : type(LOG_ARG_INT), size(sizeof(T)), i((int64_t)value) {}
+};
+
+struct LogRecord
+{
+    const char *format;
+    uint8_t level;
+    uint8_t arg_count;
+    LogArg args[LOG_MAX_ARGS];
+};
+
+/// @brief Deferred logging without heap allocations.
+/// Any task may write, only the drain task reads. If the buffer is full the message is dropped and counted.
+class Log
+{
+public:
+    template <typename... Args>
+    static inline void write(uint8_t level, const char *format, Args... args)
+    {
+        static_assert(sizeof...(Args) <= LOG_MAX_ARGS, "too many log arguments");
+        if (level > __atomic_load_n(&max_level, __ATOMIC_RELAXED))
+        {
+            return;
+        }
+        // the trailing element keeps the array non-empty for calls without arguments
+        const LogArg values[] = {LogArg(args)..., LogArg()};
+        push(level, format, values, sizeof...(Args));
+    }
+    static void beginAsync(Stream &stream);
+    static uint32_t getDropped();
+    static void setLevel(uint8_t level);
+
+private:
+    struct Slot
+    {
+        uint32_t sequence;
+        LogRecord record;
+    };
+    static Slot slots[LOG_BUFFER_RECORDS];
+    static uint32_t write_index;
+    static uint32_t read_index;
+    static uint32_t dropped;
+    static uint8_t max_level;
+    static Stream *stream;
+
+    static void push(uint8_t level, const char *format, const LogArg *args, uint8_t arg_count);
+    static bool pop(LogRecord &record);
+    static void print(const LogRecord &record);
+    static void drainTask(void *args);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef MEMORY_GOVERNOR_INCLUDED
+#define MEMORY_GOVERNOR_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <metric_registry.h>
+#include <transport.h>
+#include <log.h>
+#include <telemetry.h>
+
+// Stages of memory pressure, every stage keeps the measures of the stages below
+enum MemoryPressureStage : uint8_t
+{
+    MEMORY_STAGE_NORMAL = 0,
+    MEMORY_STAGE_QUIET = 1,         // debug logging and transport debug output off
+    MEMORY_STAGE_SLOW_SAMPLING = 2, // aggregated gauges sampled MEMORY_GOVERNOR_SAMPLING_DIVIDER times less often
+    MEMORY_STAGE_SHED = 3,          // low priority gauges are not collected and not sent
+    MEMORY_STAGE_FLUSH = 4          // Remote Write after every ingestion to keep payloads small
+};
+
+/// @brief Degrades sampling and buffering in stages when free heap or the largest free block runs low,
+/// e.g. while TLS buffers and the Remote Write payloads compete for memory.
+/// A stage is entered as soon as one of its thresholds is crossed, possibly skipping stages, and left one stage
+/// per update once both readings are MEMORY_GOVERNOR_HYSTERESIS_BYTES above its thresholds again.
+/// Histograms and summaries are never shed, so the coffee histogram keeps being sent in every stage.
+class MemoryGovernor
+{
+public:
+    MemoryGovernor(MetricRegistry &metrics, uint32_t sampling_interval_ms);
+    void setTransport(Transport *transport);
+    MemoryPressureStage update(uint32_t free_heap, uint32_t largest_block);
+    MemoryPressureStage getStage();
+    uint32_t getTransitions();
+    bool shouldFlushEarly();
+
+private:
+    MetricRegistry &metrics;
+    Transport *transport = nullptr;
+    uint32_t sampling_interval_ms;
+    volatile MemoryPressureStage stage = MEMORY_STAGE_NORMAL;
+    uint32_t transitions = 0;
+
+    MemoryPressureStage stageFor(uint32_t free_heap, uint32_t largest_block, uint32_t margin);
+    void apply(MemoryPressureStage previous);
+};
+
+#endif
@@ -0,0 +1,92 @@
+#ifndef METRIC_REGISTRY_INCLUDED
+#define METRIC_REGISTRY_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <prometheus_histogram.h>
+#include <prometheus_summary.h>
+#include <metric_series.h>
+#include <remote_write_encoder.h>
+#include <log.h>
+#include <telemetry.h>
+
+// Callback returning the current value of a gauge, called once per ingestion or sampling tick.
+typedef double (*MetricCollector)();
+
+// Low priority gauges are shed first under memory pressure, see MemoryGovernor
+enum MetricPriority : uint8_t
+{
+    METRIC_PRIORITY_LOW = 0,
+    METRIC_PRIORITY_NORMAL = 1
+};
+
+/// @brief Table of all series pushed with one Remote Write request.
+/// Series, collectors and names are kept in parallel arrays so that ingestion and reset
+/// are a single loop over the table. The samples of all gauge series are slices of one timestamp and one value block. Aggregated gauges are sampled by a task between ingestions and
+/// exported with their last sample under their own name and as _min, _max and _avg series.
+class MetricRegistry
+{
+public:
+    MetricRegistry(const char *labels, int16_t series_size, int16_t capacity);
+    ~MetricRegistry();
+    bool addGauge(const char *name, MetricCollector collector, MetricPriority priority = METRIC_PRIORITY_NORMAL);
+    bool addAggregatedGauge(const char *name, MetricCollector collector, MetricPriority priority = METRIC_PRIORITY_NORMAL);
+    void beginSampling(uint32_t interval_ms);
+    void setSamplingInterval(uint32_t interval_ms);
+    void setMinimumPriority(MetricPriority priority);
+    void sample();
+    bool addHistogram(Prometheus_Histogram *histogram);
+    bool addSummary(Prometheus_Summary *summary);
+    void Ingest(int64_t timestamp);
+    void resetSamples();
+    size_t encode(RemoteWriteEncoder &encoder);
+    size_t maxEncodedSize();
+
+private:
+    const char *labels;
+    int16_t series_size;
+    int16_t capacity;
+    int16_t gauge_count = 0;
+    MetricSeries **gauge_series;
+    MetricCollector *gauge_collectors;
+    const char **gauge_names;
+    uint16_t *gauge_telemetry_ids;
+    MetricPriority *gauge_priorities;
+    Prometheus_Histogram **histograms;
+    int16_t histogram_count = 0;
+    Prometheus_Summary **summaries;
+    int16_t summary_count = 0;
+    volatile MetricPriority minimum_priority = METRIC_PRIORITY_LOW;
+
+    // sample blocks of all gauge series, series_size entries per series in registration order
+    int16_t sample_series_count = 0;
+    int64_t *sample_timestamps = nullptr;
+    double *sample_values = nullptr;
+
+    // aggregated gauges, last sample and running min/max/sum/count since the last ingestion
+    int16_t aggregate_count = 0;
+    MetricCollector *aggregate_collectors;
+    const char **aggregate_names;
+    uint16_t *aggregate_telemetry_ids;
+    MetricPriority *aggregate_priorities;
+    MetricSeries **aggregate_last_series;
+    MetricSeries **aggregate_min_series;
+    MetricSeries **aggregate_max_series;
+    MetricSeries **aggregate_avg_series;
+    double *aggregate_last;
+    double *aggregate_min;
+    double *aggregate_max;
+    double *aggregate_sum;
+    uint32_t *aggregate_samples;
+    portMUX_TYPE aggregate_mux = portMUX_INITIALIZER_UNLOCKED;
+    TaskHandle_t sampling_task = NULL;
+    volatile uint32_t sampling_interval_ms = 0;
+    uint32_t sampling_ticks = 0;
+    int64_t sampling_time_us = 0;
+
+    int16_t growSamples(int16_t new_series);
+    void ingestSample(MetricSeries *series, int64_t timestamp, double value, const char *name, const char *suffix);
+    static void samplingTask(void *args);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef METRIC_SERIES_INCLUDED
+#define METRIC_SERIES_INCLUDED
+
+#include <Arduino.h>
+#include <remote_write_encoder.h>
+
+/// @brief Name, labels and the samples of one series since the last push.
+/// The samples are stored once and encoded by whichever Remote Write encoder an endpoint needs.
+class MetricSeries
+{
+public:
+    MetricSeries(uint16_t series_size, const char *name, const char *labels);
+    MetricSeries(uint16_t series_size, const char *name, const char *labels, int64_t *timestamps, double *values);
+    ~MetricSeries();
+    void moveSamples(int64_t *timestamps, double *values);
+    bool addSample(int64_t timestamp, double value);
+    void resetSamples();
+    bool encode(RemoteWriteEncoder &encoder);
+    size_t maxEncodedSize();
+    const char *errmsg = nullptr;
+
+private:
+    std::string name;
+    std::string labels;
+    uint16_t series_size;
+    uint16_t count = 0;
+    int64_t *timestamps;
+    double *values;
+    bool owns_samples;
+};
+
+#endif
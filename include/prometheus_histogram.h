@@ -3,14 +3,17 @@
 
 #include "config.h"
 #include <Arduino.h>
-#include <PrometheusArduino.h>
+#include <trace.h>
+#include <log.h>
+#include <telemetry.h>
+#include <metric_series.h>
 
 class Prometheus_Histogram
 {
 private:
-    TimeSeries **time_series_buckets;
-    TimeSeries *time_series_count;
-    TimeSeries *time_series_sum;
+    MetricSeries **time_series_buckets;
+    MetricSeries *time_series_count;
+    MetricSeries *time_series_sum;
     int16_t buckets_start_value;
     int16_t buckets_value_increment;
     int16_t bucket_count;
@@ -22,14 +25,17 @@ private:
     char *name;
     std::string labels;
     bool initialized = false;
+    uint16_t telemetry_id;
     SemaphoreHandle_t update_sem;
 
 public:
     Prometheus_Histogram(const char *name, const char *labels, int16_t series_size, int16_t buckets_start_value, int16_t buckets_value_increment, int16_t bucket_count);
-    void init(WriteRequest &req);
+    void init();
     void AddValue(int64_t value);
     void Ingest(int64_t timestamp);
     void resetSamples();
+    bool encode(RemoteWriteEncoder &encoder);
+    size_t maxEncodedSize();
 };
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef Prometheus_Summary_INCLUDED
+#define Prometheus_Summary_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <quantile_sketch.h>
+#include <trace.h>
+#include <log.h>
+#include <metric_series.h>
+
+/// @brief Prometheus summary exporting quantiles over a sliding time window.
+/// The window is split into window_count slices, each backed by a QuantileSketch. The oldest slice is
+/// cleared when the window advances, so memory stays fixed. Sum and count cover the whole lifetime.
+class Prometheus_Summary
+{
+private:
+    MetricSeries **time_series_quantiles;
+    MetricSeries *time_series_count;
+    MetricSeries *time_series_sum;
+    const double *quantiles;
+    int16_t quantile_count;
+    int16_t series_size;
+    QuantileSketch **windows;
+    QuantileSketch *merged;
+    int16_t window_count;
+    int16_t current_window = 0;
+    int64_t window_slice_ms;
+    int64_t window_start_ms;
+    int64_t sum = 0;
+    int64_t count = 0;
+    char *name;
+    std::string labels;
+    SemaphoreHandle_t update_sem;
+
+    void advanceWindow(int64_t now_ms);
+
+public:
+    Prometheus_Summary(const char *name, const char *labels, int16_t series_size, const double *quantiles, int16_t quantile_count, int32_t window_seconds, int16_t window_count, uint16_t compression);
+    void init();
+    void AddValue(int64_t value);
+    void Ingest(int64_t timestamp);
+    void resetSamples();
+    bool encode(RemoteWriteEncoder &encoder);
+    size_t maxEncodedSize();
+};
+
+#endif
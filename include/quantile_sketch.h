@@ -0,0 +1,42 @@
+#ifndef QUANTILE_SKETCH_INCLUDED
+#define QUANTILE_SKETCH_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Merging t-digest with a fixed number of centroids.
+/// All memory is allocated in the constructor: (2 * compression + 1) centroids of 8 bytes each.
+/// Has no Arduino dependencies so it can be benchmarked on the host with tools/quantile_bench.
+class QuantileSketch
+{
+public:
+    QuantileSketch(uint16_t compression);
+    ~QuantileSketch();
+    void add(double value, uint32_t weight = 1);
+    void addSketch(QuantileSketch &other);
+    double quantile(double q);
+    uint64_t count();
+    void reset();
+    size_t memoryBytes();
+
+private:
+    struct Centroid
+    {
+        float mean;
+        uint32_t weight;
+    };
+
+    uint16_t compression;
+    uint16_t centroid_capacity;
+    Centroid *centroids;
+    uint16_t centroid_count = 0;
+    uint16_t buffered_count = 0;
+    uint64_t total_weight = 0;
+    double min = 0;
+    double max = 0;
+
+    void compress();
+    double scale(double q);
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef REMOTE_WRITE_ENCODER_INCLUDED
+#define REMOTE_WRITE_ENCODER_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of labels per series, including __name__
+#define REMOTE_WRITE_MAX_LABELS 16
+// Varint size of Unix timestamps in milliseconds before the year 19800, used to bound the size of a request
+#define REMOTE_WRITE_MAX_TIMESTAMP_BYTES 7
+
+/// @brief A label of a series, pointing into the name and label strings passed to addSeries().
+struct RemoteWriteLabel
+{
+    const char *name;
+    size_t name_length;
+    const char *value;
+    size_t value_length;
+};
+
+/// @brief Base of the Remote Write protobuf encoders. Series are written into a fixed buffer, so encoding
+/// never allocates. If anything does not fit, the encoder stops writing and finish() returns 0.
+/// The buffer is either owned or passed in, so encoders that are never used at the same time can share one.
+/// Has no Arduino dependencies so payloads can be built and checked on the host.
+class RemoteWriteEncoder
+{
+public:
+    RemoteWriteEncoder(size_t buffer_size);
+    RemoteWriteEncoder(uint8_t *buffer, size_t buffer_size);
+    virtual ~RemoteWriteEncoder();
+    static size_t maxSeriesSize(const char *name, const char *labels, uint16_t count);
+    virtual void reset();
+    /// @brief Adds a series with its samples.
+    /// @param labels Labels in the format {name="value",...}. Escape sequences in values are not decoded.
+    /// @return false if the buffer or the label limit was exceeded.
+    virtual bool addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count) = 0;
+    virtual size_t finish();
+    virtual uint8_t remoteWriteVersion() = 0;
+    const uint8_t *data();
+    size_t length();
+    const char *errmsg = nullptr;
+
+protected:
+    uint8_t *buffer;
+    size_t buffer_size;
+    bool owns_buffer;
+    size_t position = 0;
+    bool overflow = false;
+
+    int parseLabels(const char *name, const char *labels, RemoteWriteLabel *result);
+    static size_t varintSize(uint64_t value);
+    static size_t samplesSize(const int64_t *timestamps, uint16_t count);
+    void writeSamples(const int64_t *timestamps, const double *values, uint16_t count);
+    void writeByte(uint8_t value);
+    void writeVarint(uint64_t value);
+    void writeBytes(const void *data, size_t len);
+};
+
+#endif
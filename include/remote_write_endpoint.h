@@ -0,0 +1,53 @@
+#ifndef REMOTE_WRITE_ENDPOINT_INCLUDED
+#define REMOTE_WRITE_ENDPOINT_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <ArduinoHttpClient.h>
+#include <PrometheusArduino.h>
+#include <prometheus_histogram.h>
+#include <remote_write_payload.h>
+#include <trace.h>
+#include <log.h>
+#include <telemetry.h>
+
+/// @brief A Remote Write receiver with its own connection, credentials, queue and retry state.
+/// Payloads are sent by a dedicated task, so a slow or unreachable endpoint never blocks the
+/// main loop or other endpoints. If the queue is full, the oldest payload is dropped.
+class RemoteWriteEndpoint
+{
+public:
+    RemoteWriteEndpoint(const char *name, const char *host, uint16_t port, const char *path, const char *ca_cert, const char *user, const char *pass, uint8_t remote_write_version);
+    ~RemoteWriteEndpoint();
+    void setSendDurationHistogram(Prometheus_Histogram *send_duration);
+    void beginAsync();
+    void enqueue(RemoteWritePayload *payload);
+    uint8_t getRemoteWriteVersion();
+    bool isRemoteWriteVersionConfirmed();
+    int32_t getFailures();
+    const char *getName();
+
+private:
+    const char *name;
+    const char *host;
+    uint16_t port;
+    const char *path;
+    const char *user;
+    const char *pass;
+    volatile uint8_t remoteWriteVersion;
+    volatile bool remoteWriteVersionConfirmed = false;
+    Client *client;
+    HttpClient *httpClient;
+    QueueHandle_t queue;
+    TaskHandle_t sendTaskHandle = NULL;
+    Prometheus_Histogram *sendDuration = nullptr;
+    int32_t failures = 0; // incremented by the main and the send task, only accessed with __atomic builtins
+
+    PromClient::SendResult post(RemoteWritePayload *payload);
+    bool matchRemoteWriteVersion(RemoteWritePayload *&payload);
+    static void sendTask(void *args);
+};
+
+#endif
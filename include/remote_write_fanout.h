@@ -0,0 +1,43 @@
+#ifndef REMOTE_WRITE_FANOUT_INCLUDED
+#define REMOTE_WRITE_FANOUT_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <snappy.h>
+#include <metric_registry.h>
+#include <remote_write_endpoint.h>
+#include <remote_write_payload.h>
+#include <remote_write_v1.h>
+#include <remote_write_v2.h>
+#include <log.h>
+
+/// @brief Sends the same metrics to several Remote Write endpoints.
+/// Every push is encoded once per protocol version in use and the resulting payload is shared by
+/// the queues of all endpoints using that version. Both versions are encoded one after the other into the
+/// same buffer, sized for the registered series. The buffers are only allocated for the duration of a push.
+class RemoteWriteFanout
+{
+public:
+    RemoteWriteFanout(MetricRegistry &metrics, uint8_t max_endpoints);
+    ~RemoteWriteFanout();
+    bool addEndpoint(RemoteWriteEndpoint *endpoint);
+    void beginAsync();
+    bool push();
+    int32_t getFailures();
+
+private:
+    MetricRegistry &metrics;
+    RemoteWriteEndpoint **endpoints;
+    uint8_t endpoint_count = 0;
+    uint8_t max_endpoints;
+    int32_t missed_payloads = 0;
+    // only allocated during push()
+    uint8_t *buffer = nullptr;
+    size_t buffer_size = 0;
+    struct snappy_env snappy_env;
+
+    RemoteWritePayload *encode(uint8_t remote_write_version);
+    RemoteWritePayload *compress(const uint8_t *data, size_t raw_length, uint8_t remote_write_version);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef REMOTE_WRITE_PAYLOAD_INCLUDED
+#define REMOTE_WRITE_PAYLOAD_INCLUDED
+
+#include <Arduino.h>
+
+/// @brief Snappy compressed Remote Write request shared by all endpoints that send it.
+/// Reference counted: every endpoint queue holding the payload owns one reference, and the
+/// payload is freed when the last endpoint releases it.
+/// A Remote Write 2.0 payload can carry the same samples encoded as 1.0, for endpoints that turn out not to support 2.0.
+class RemoteWritePayload
+{
+public:
+    static RemoteWritePayload *create(const uint8_t *data, size_t length, uint8_t remote_write_version);
+    void retain();
+    void release();
+    const uint8_t *data();
+    size_t length();
+    uint8_t remoteWriteVersion();
+    void setFallback(RemoteWritePayload *fallback);
+    RemoteWritePayload *getFallback();
+
+private:
+    RemoteWritePayload(uint8_t *data, size_t length, uint8_t remote_write_version);
+    ~RemoteWritePayload();
+    uint8_t *payload_data;
+    size_t payload_length;
+    uint8_t remote_write_version;
+    uint32_t references = 1;
+    RemoteWritePayload *fallback = nullptr;
+};
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef REMOTE_WRITE_V1_INCLUDED
+#define REMOTE_WRITE_V1_INCLUDED
+
+#include <remote_write_encoder.h>
+
+/// @brief Encodes a Remote Write 1.0 prometheus.WriteRequest protobuf.
+/// Every series carries its metric name and labels as strings.
+class RemoteWriteV1Encoder : public RemoteWriteEncoder
+{
+public:
+    RemoteWriteV1Encoder(size_t buffer_size);
+    RemoteWriteV1Encoder(uint8_t *buffer, size_t buffer_size);
+    bool addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count);
+    uint8_t remoteWriteVersion();
+
+private:
+    static size_t labelSize(const RemoteWriteLabel &label);
+};
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef REMOTE_WRITE_V2_INCLUDED
+#define REMOTE_WRITE_V2_INCLUDED
+
+#include <remote_write_encoder.h>
+
+/// @brief Encodes an io.prometheus.write.v2.Request protobuf.
+/// Metric names and label names/values are interned in a per-request symbol table, so every string
+/// is written once no matter how many series use it. Symbols point into the strings passed to
+/// addSeries(), which must stay valid until finish() returns.
+class RemoteWriteV2Encoder : public RemoteWriteEncoder
+{
+public:
+    RemoteWriteV2Encoder(size_t buffer_size, uint16_t max_symbols);
+    RemoteWriteV2Encoder(uint8_t *buffer, size_t buffer_size, uint16_t max_symbols);
+    ~RemoteWriteV2Encoder();
+    void reset();
+    bool addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count);
+    size_t finish();
+    uint8_t remoteWriteVersion();
+    uint16_t symbolCount();
+
+private:
+    const char **symbols;
+    uint16_t *symbol_lengths;
+    uint16_t max_symbols;
+    uint16_t symbol_count = 0;
+
+    uint32_t intern(const char *str, size_t len);
+};
+
+#endif
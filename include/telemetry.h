@@ -0,0 +1,119 @@
+#ifndef TELEMETRY_INCLUDED
+#define TELEMETRY_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+
+// Frame types of the binary telemetry stream. Keep in sync with tools/telemetry_decoder.py
+//   frame = COBS(body + crc16(body)) 0x00
+//   body  = type:u8 sequence:u8 timestamp_us:u32 payload, little endian
+enum class TelemetryFrame : uint8_t
+{
+    Name = 1,      // payload: id:u16 kind:u8 name
+    Histogram = 2, // payload: id:u16 value:i64
+    Gauge = 3,     // payload: id:u16 value:f64
+    Event = 4,     // payload: event:u16 arg:i64
+    Text = 5,      // payload: text, one log line
+    Stats = 6      // payload: dropped frames:u32
+};
+
+enum class TelemetryKind : uint8_t
+{
+    Histogram = 1,
+    Gauge = 2
+};
+
+// Events sent with TelemetryFrame::Event
+enum TelemetryEvent : uint16_t
+{
+    TELEMETRY_EVENT_VIBRATION_EDGE = 1,    // arg: 1 if vibrating, 0 if not
+    TELEMETRY_EVENT_COFFEE = 2,            // arg: brew duration in ms
+    TELEMETRY_EVENT_WIFI_CONNECTED = 3,    // arg: connect duration in ms
+    TELEMETRY_EVENT_WIFI_DISCONNECTED = 4, // arg: unused
+    TELEMETRY_EVENT_REMOTE_WRITE = 5,      // arg: HTTP status, negative if the request failed
+    TELEMETRY_EVENT_MEMORY_STAGE = 6       // arg: MemoryPressureStage
+};
+
+struct TelemetryRecord
+{
+    TelemetryFrame type;
+    uint16_t id;
+    uint32_t timestamp_us;
+    union
+    {
+        int64_t i;
+        double d;
+    };
+};
+
+/// @brief Binary telemetry stream of histogram values, gauge samples and events over serial.
+/// Recording only queues a 16 byte record and compiles away if ENABLE_TELEMETRY is false. A low priority
+/// task frames the records and writes them at TELEMETRY_BAUD. Names are sent again every
+/// TELEMETRY_NAMES_INTERVAL_MS, so a decoder can attach at any time. If the queue is full, records are dropped.
+class Telemetry
+{
+public:
+    static void beginAsync(Stream &stream);
+    static uint16_t registerName(TelemetryKind kind, const char *name);
+    static inline void histogram(uint16_t id, int64_t value)
+    {
+        if (!ENABLE_TELEMETRY)
+            return;
+        TelemetryRecord record = {TelemetryFrame::Histogram, id, (uint32_t)esp_timer_get_time(), {value}};
+        push(record);
+    }
+    static inline void gauge(uint16_t id, double value)
+    {
+        if (!ENABLE_TELEMETRY)
+            return;
+        TelemetryRecord record = {TelemetryFrame::Gauge, id, (uint32_t)esp_timer_get_time(), {0}};
+        record.d = value;
+        push(record);
+    }
+    static inline void event(TelemetryEvent event, int64_t arg = 0)
+    {
+        if (!ENABLE_TELEMETRY)
+            return;
+        TelemetryRecord record = {TelemetryFrame::Event, event, (uint32_t)esp_timer_get_time(), {arg}};
+        push(record);
+    }
+    static void writeText(const uint8_t *text, size_t length);
+
+private:
+    friend class TelemetryStream;
+    static Stream *stream;
+    static QueueHandle_t queue;
+    static SemaphoreHandle_t write_sem;
+    static const char *names[TELEMETRY_MAX_NAMES];
+    static TelemetryKind kinds[TELEMETRY_MAX_NAMES];
+    static uint16_t name_count;
+    static uint8_t sequence;
+    static uint32_t dropped;
+
+    static void push(const TelemetryRecord &record);
+    static void writeFrame(TelemetryFrame type, uint32_t timestamp_us, const uint8_t *payload, size_t length);
+    static void writeRecord(const TelemetryRecord &record);
+    static void writeNames();
+    static void sendTask(void *args);
+};
+
+/// @brief Stream that sends every line written to it as a text frame, so log output and trace dumps
+/// can share the serial port with the binary stream. Safe to share between tasks, but lines written at the
+/// same time may be mixed, use one instance per writer.
+class TelemetryStream : public Stream
+{
+public:
+    using Print::write;
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    void flush() {}
+
+private:
+    uint8_t line[TELEMETRY_MAX_TEXT];
+    size_t length = 0;
+};
+
+#endif
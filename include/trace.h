@@ -0,0 +1,77 @@
+#ifndef TRACE_INCLUDED
+#define TRACE_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+
+// Events stored in the trace ring buffer. Keep in sync with tools/trace_to_chrome.py
+enum class TraceEvent : uint8_t
+{
+    TaskBegin = 1,   // arg: TraceSpan
+    TaskEnd = 2,     // arg: TraceSpan
+    SemWait = 3,     // arg: TraceSemaphore
+    SemAcquired = 4, // arg: TraceSemaphore
+    SemReleased = 5, // arg: TraceSemaphore
+    GpioEdge = 6,    // arg: pin << 1 | level
+    SendBegin = 7,   // arg: unused
+    SendEnd = 8,     // arg: PromClient::SendResult
+    Value = 9        // arg: value, clipped to 16 bit
+};
+
+// Work spans recorded with TaskBegin/TaskEnd
+enum TraceSpan : uint16_t
+{
+    TRACE_SPAN_MAIN_LOOP = 0,
+    TRACE_SPAN_VIBRATION_DETECT = 1,
+    TRACE_SPAN_TRANSPORT_CONNECT = 2,
+    TRACE_SPAN_HISTOGRAM_INGEST = 3
+};
+
+// Semaphores recorded with SemWait/SemAcquired/SemReleased
+enum TraceSemaphore : uint16_t
+{
+    TRACE_SEM_HISTOGRAM_UPDATE = 0,
+    TRACE_SEM_TRANSPORT = 1,
+    TRACE_SEM_SUMMARY_UPDATE = 2
+};
+
+struct TraceRecord
+{
+    uint32_t timestamp_us;
+    uint32_t task;
+    uint8_t event;
+    uint8_t core;
+    uint16_t arg;
+};
+
+/// @brief Fixed-size binary ring buffer of trace events.
+/// Recording is a single atomic increment plus a 12 byte store, and compiles away if ENABLE_TRACE is false.
+/// The buffer is dumped over serial as hex lines which tools/trace_to_chrome.py converts to a Chrome trace.
+class Trace
+{
+public:
+    static inline void record(TraceEvent event, uint16_t arg = 0)
+    {
+        if (!ENABLE_TRACE)
+            return;
+        uint32_t index = __atomic_fetch_add(&next_index, 1, __ATOMIC_RELAXED) % TRACE_BUFFER_RECORDS;
+        fill(buffer[index], event, arg);
+    }
+    static void dump(Stream &stream);
+
+private:
+    static TraceRecord buffer[TRACE_BUFFER_RECORDS];
+    static uint32_t next_index;
+
+    static inline void fill(TraceRecord &record, TraceEvent event, uint16_t arg)
+    {
+        record.timestamp_us = (uint32_t)esp_timer_get_time();
+        record.task = (uint32_t)(uintptr_t)xTaskGetCurrentTaskHandle();
+        record.event = static_cast<uint8_t>(event);
+        record.core = (uint8_t)xPortGetCoreID();
+        record.arg = arg;
+    }
+    static uint32_t measureRecordNanos();
+};
+
+#endif
@@ -6,30 +6,61 @@
 #include <PrometheusArduino.h>
 #include <PromLokiTransport.h>
 #include <WiFi.h>
+#include <trace.h>
+#include <log.h>
+#include <wifi_connection.h>
+#include <prometheus_histogram.h>
+
+/// @brief Debug stream of the transport, forwards to the stream set with setDebug() unless muted.
+/// The mute flag is checked on every call, so muting applies at once, also in the middle of a connect or reconnect.
+class MutableStream : public Stream
+{
+public:
+    using Print::write;
+    void setStream(Stream *stream) { this->stream = stream; }
+    void setMuted(bool muted) { __atomic_store_n(&this->muted, muted, __ATOMIC_RELAXED); }
+    size_t write(uint8_t c) { return isMuted() ? 1 : stream->write(c); }
+    size_t write(const uint8_t *buffer, size_t size) { return isMuted() ? size : stream->write(buffer, size); }
+    int available() { return isMuted() ? 0 : stream->available(); }
+    int read() { return isMuted() ? -1 : stream->read(); }
+    int peek() { return isMuted() ? -1 : stream->peek(); }
+    void flush()
+    {
+        if (!isMuted())
+            stream->flush();
+    }
+
+private:
+    Stream *stream = nullptr;
+    bool muted = false;
+    bool isMuted() { return stream == nullptr || __atomic_load_n(&muted, __ATOMIC_RELAXED); }
+};
 
 class Transport
 {
 public:
     Transport(const int wifi_status_pin, const char *wifi_ssid, const char *wifi_password);
     ~Transport();
-    void setEndpoint(uint16_t port, const char *host, char *path);
-    void setCredentials(const char *user, const char *pass);
     void setDebug(Stream &stream);
+    void setDebugMuted(bool muted);
     void beginAsync();
     bool isInitialized();
     int64_t getTimeMillis();
-    PromClient::SendResult send(WriteRequest &req);
+    void setConnectDurationHistogram(Prometheus_Histogram *connect_duration);
+    int32_t getWifiFastConnectFailures();
 
 private:
     const char *wifiSSID;
     const char *wifiPassword;
     PromLokiTransport promTransport;
-    PromClient promClient;
-    Stream *debug = nullptr;
+    WifiConnection wifi;
     TaskHandle_t connectTaskHandle = NULL;
     TaskHandle_t blinkTaskHandle = NULL;
     SemaphoreHandle_t semaphore;
     bool transportInitialized = false;
+    MutableStream debugStream;
+    char exceptionMessage[LOG_LINE_LENGTH];
+    void logException(const std::exception &e);
 
     // led blinking
     enum class StatusIndicator
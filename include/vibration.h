@@ -4,22 +4,27 @@
 #include "config.h"
 #include <Arduino.h>
 #include <prometheus_histogram.h>
+#include <prometheus_summary.h>
+#include <trace.h>
+#include <log.h>
+#include <telemetry.h>
+#include <vibration_detector.h>
 
 class Vibration
 {
 public:
-    Vibration(hw_timer_t *timer, int32_t vibration_detection_threshold_ms, Prometheus_Histogram *coffees_consumed);
+    Vibration(int32_t vibration_detection_threshold_ms, Prometheus_Histogram *coffees_consumed, Prometheus_Summary *brew_duration = nullptr);
     ~Vibration();
     void beginAsync();
 
 private:
     TaskHandle_t vibration_detection_task = NULL;
-    hw_timer_t *timer;
-    int32_t vibration_detection_threshold_ms;
+    VibrationDetector detector;
     Prometheus_Histogram *coffees_consumed;
+    Prometheus_Summary *brew_duration;
 
     static void vibration_dection_task(void *args);
-    static int64_t detect_vibration(hw_timer_t *timer);
+    void poll_vibration();
 };
 
 #endif
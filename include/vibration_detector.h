@@ -0,0 +1,28 @@
+#ifndef VIBRATION_DETECTOR_INCLUDED
+#define VIBRATION_DETECTOR_INCLUDED
+
+#include <stdint.h>
+
+struct VibrationEvent
+{
+    int64_t start_ms;
+    int64_t duration_ms;
+    bool counted; // true if the duration reached the detection threshold
+};
+
+/// @brief Turns polled vibration sensor levels into vibration events.
+/// Has no Arduino dependencies so the same code runs on the device and in tools/vibration_replay.
+class VibrationDetector
+{
+public:
+    VibrationDetector(int32_t vibration_detection_threshold_ms);
+    bool update(int64_t now_ms, bool vibrating, VibrationEvent &event);
+    bool isVibrating();
+
+private:
+    int32_t vibration_detection_threshold_ms;
+    bool vibrating = false;
+    int64_t vibration_start_ms = 0;
+};
+
+#endif
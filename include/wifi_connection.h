@@ -0,0 +1,57 @@
+#ifndef WIFI_CONNECTION_INCLUDED
+#define WIFI_CONNECTION_INCLUDED
+
+#include "config.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp32/rtc.h>
+#include <prometheus_histogram.h>
+#include <log.h>
+#include <telemetry.h>
+
+// Last successful association, kept in RTC memory so it survives deep sleep and soft resets
+struct WifiConnectionCache
+{
+    uint32_t magic;
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    int64_t lease_start_us; // RTC time of the DHCP handout, which keeps counting through deep sleep and soft resets
+};
+
+/// @brief Reconnects to the access point of the last connection on its channel, skipping the scan,
+/// and reuses the last IP lease to skip DHCP while it is younger than WIFI_FAST_CONNECT_LEASE_SECONDS.
+/// Falls back to a full scan with DHCP if that fails.
+/// Connection changes are signalled to a task via task notifications instead of polling.
+class WifiConnection
+{
+public:
+    WifiConnection(const char *wifi_ssid, const char *wifi_password);
+    void begin();
+    void setNotifyTask(TaskHandle_t notify_task);
+    bool reconnect();
+    void renewExpiredLease();
+    bool isConnected();
+    void setConnectDurationHistogram(Prometheus_Histogram *connect_duration);
+    int32_t getFastConnectFailures();
+
+private:
+    const char *wifiSSID;
+    const char *wifiPassword;
+    TaskHandle_t notifyTask = NULL;
+    Prometheus_Histogram *connectDuration = nullptr;
+    volatile bool connected = false;
+    bool connecting = false;
+    bool usingCachedLease = false;
+    int32_t fastConnectFailures = 0;
+
+    bool connect(bool fast);
+    bool isLeaseValid();
+    void storeCache();
+    void onWifiEvent(arduino_event_id_t event);
+};
+
+#endif
@@ -0,0 +1,260 @@
+#include "log.h"
+
+static_assert((LOG_BUFFER_RECORDS & (LOG_BUFFER_RECORDS - 1)) == 0, "LOG_BUFFER_RECORDS must be a power of two");
+
+// Every slot carries a sequence number. For the writer with index i, the slot is free if its sequence
+// equals the first index of the lap of i, and written if it equals that plus one. The drain task frees a slot
+// by setting it to the first index of the next lap. All sequences start at 0, free for the first lap.
+Log::Slot Log::slots[LOG_BUFFER_RECORDS];
+uint32_t Log::write_index = 0;
+uint32_t Log::read_index = 0;
+uint32_t Log::dropped = 0;
+uint8_t Log::max_level = LOG_LEVEL;
+Stream *Log::stream = nullptr;
+
+static inline uint32_t lapStart(uint32_t index)
+{
+    return index & ~(uint32_t)(LOG_BUFFER_RECORDS - 1);
+}
+
+/// @brief Claims a slot with a compare-and-swap on the write index and copies the record into it.
+void Log::push(uint8_t level, const char *format, const LogArg *args, uint8_t arg_count)
+{
+    uint32_t index = __atomic_load_n(&write_index, __ATOMIC_RELAXED);
+    Slot *slot;
+    while (true)
+    {
+        slot = &slots[index % LOG_BUFFER_RECORDS];
+        uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(sequence - lapStart(index));
+        if (diff == 0)
+        {
+            // on failure, index is updated to the current write index
+            if (__atomic_compare_exchange_n(&write_index, &index, index + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // the slot still holds a record of the previous lap, the buffer is full
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        else
+        {
+            index = __atomic_load_n(&write_index, __ATOMIC_RELAXED);
+        }
+    }
+    slot->record.format = format;
+    slot->record.level = level;
+    slot->record.arg_count = arg_count;
+    for (uint8_t i = 0; i < arg_count; i++)
+    {
+        slot->record.args[i] = args[i];
+    }
+    __atomic_store_n(&slot->sequence, lapStart(index) + 1, __ATOMIC_RELEASE);
+}
+
+/// @brief Takes the oldest record off the buffer. Only called by the drain task.
+/// @return false if the buffer is empty or the oldest record is still being written.
+bool Log::pop(LogRecord &record)
+{
+    Slot &slot = slots[read_index % LOG_BUFFER_RECORDS];
+    if (__atomic_load_n(&slot.sequence, __ATOMIC_ACQUIRE) != lapStart(read_index) + 1)
+    {
+        return false;
+    }
+    record = slot.record;
+    __atomic_store_n(&slot.sequence, lapStart(read_index) + LOG_BUFFER_RECORDS, __ATOMIC_RELEASE);
+    read_index++;
+    return true;
+}
+
+/// @brief Value of an argument for %d and %i.
+static long long signedValue(const LogArg &value)
+{
+    if (value.type == LOG_ARG_DOUBLE)
+    {
+        return (long long)value.d;
+    }
+    if (value.type != LOG_ARG_INT)
+    {
+        return (intptr_t)value.p;
+    }
+    return value.i;
+}
+
+/// @brief Value of an argument for the unsigned integer conversions. Integers are cut back to the width they were
+/// logged with, so a negative int32_t prints as 32 bits and not sign-extended to 64.
+static unsigned long long unsignedValue(const LogArg &value)
+{
+    if (value.type != LOG_ARG_INT || value.size >= sizeof(uint64_t))
+    {
+        return (unsigned long long)signedValue(value);
+    }
+    return (uint64_t)value.i & ((1ULL << (value.size * 8)) - 1);
+}
+
+/// @brief Value of an argument for %p.
+static void *pointerValue(const LogArg &value)
+{
+    if (value.type == LOG_ARG_STRING || value.type == LOG_ARG_POINTER)
+    {
+        return (void *)value.p;
+    }
+    return (void *)(uintptr_t)unsignedValue(value);
+}
+
+/// @brief Formats a record into a stack buffer and writes it as one line.
+/// Conversions are rewritten to the stored argument type, so "%d" works for any integer and "%f" for an integer argument.
+void Log::print(const LogRecord &record)
+{
+    char line[LOG_LINE_LENGTH];
+    size_t length = 0;
+    uint8_t arg = 0;
+    const char *p = record.format;
+    while (*p != '\0' && length < sizeof(line) - 1)
+    {
+        if (*p != '%')
+        {
+            line[length++] = *p++;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            line[length++] = '%';
+            p += 2;
+            continue;
+        }
+
+        // copy flags, width and precision, drop length modifiers
+        char spec[16];
+        size_t spec_length = 0;
+        spec[spec_length++] = *p++;
+        while (*p != '\0' && strchr("-+ #0123456789.", *p) != nullptr && spec_length < sizeof(spec) - 4)
+        {
+            spec[spec_length++] = *p++;
+        }
+        while (*p != '\0' && strchr("hljztL", *p) != nullptr)
+        {
+            p++;
+        }
+        char conversion = *p;
+        if (conversion == '\0')
+        {
+            break;
+        }
+        p++;
+
+        LogArg value = arg < record.arg_count ? record.args[arg] : LogArg();
+        arg++;
+        size_t available = sizeof(line) - length;
+        int written;
+        if (strchr("fFeEgGaA", conversion) != nullptr)
+        {
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, value.type == LOG_ARG_DOUBLE ? value.d : (double)value.i);
+        }
+        else if (conversion == 's')
+        {
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, value.type == LOG_ARG_STRING && value.s != nullptr ? value.s : "(null)");
+        }
+        else if (conversion == 'c')
+        {
+            spec[spec_length++] = 'c';
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, (int)value.i);
+        }
+        else if (conversion == 'd' || conversion == 'i')
+        {
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, signedValue(value));
+        }
+        else if (strchr("uxXo", conversion) != nullptr)
+        {
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = 'l';
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, unsignedValue(value));
+        }
+        else if (conversion == 'p')
+        {
+            spec[spec_length++] = 'p';
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, spec, pointerValue(value));
+        }
+        else
+        {
+            // not passed to snprintf, e.g. %n would write through the argument
+            spec[spec_length++] = conversion;
+            spec[spec_length] = '\0';
+            written = snprintf(line + length, available, "%s", spec);
+        }
+        if (written < 0)
+        {
+            break;
+        }
+        length += (size_t)written < available ? written : available - 1;
+    }
+    line[length] = '\0';
+    stream->println(line);
+}
+
+/// @brief Starts the task writing buffered messages to the stream. Messages logged before are kept.
+void Log::beginAsync(Stream &stream)
+{
+    if (Log::stream != nullptr)
+    {
+        return;
+    }
+    Log::stream = &stream;
+    xTaskCreatePinnedToCore(
+        Log::drainTask,
+        "log drain",
+        4096, /* Stack size in words */
+        nullptr,
+        1, /* Priority of the task */
+        nullptr,
+        tskNO_AFFINITY);
+}
+
+/// @brief Number of messages dropped because the buffer was full.
+uint32_t Log::getDropped()
+{
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
+
+/// @brief Changes the level at runtime, e.g. to drop debug messages under memory pressure.
+/// Levels above LOG_LEVEL are not compiled in and cannot be enabled.
+void Log::setLevel(uint8_t level)
+{
+    __atomic_store_n(&max_level, level < LOG_LEVEL ? level : LOG_LEVEL, __ATOMIC_RELAXED);
+}
+
+void Log::drainTask(void *args)
+{
+    uint32_t reported_dropped = 0;
+    LogRecord record;
+    while (true)
+    {
+        while (pop(record))
+        {
+            print(record);
+        }
+        uint32_t current_dropped = getDropped();
+        if (current_dropped != reported_dropped)
+        {
+            stream->printf("%u log messages dropped\n", current_dropped - reported_dropped);
+            reported_dropped = current_dropped;
+        }
+        vTaskDelay(LOG_DRAIN_INTERVAL_MS / portTICK_PERIOD_MS);
+    }
+}
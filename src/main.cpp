@@ -13,6 +13,13 @@
 #include <vibration.h>
 #include <transport.h>
 #include <prometheus_histogram.h>
+#include <metric_registry.h>
+#include <trace.h>
+#include <log.h>
+#include <telemetry.h>
+#include <memory_governor.h>
+#include <remote_write_fanout.h>
+#include <remote_write_endpoint.h>
 #include <tuple>
 #include "esp32-hal-cpu.h"
 
@@ -31,10 +38,12 @@ SET_LOOP_TASK_STACK_SIZE(32768);
 bool performRemoteWrite();
 void handleSampleIngestion();
 void handleMetricsSend();
-void ingestMetricSample(TimeSeries &ts, int64_t timestamp, double value, String name);
+RemoteWriteEndpoint *setupEndpoint(const char *name, const char *host, uint16_t port, const char *path, const char *ca_cert,
+                                   const char *user, const char *pass, uint8_t remote_write_version, std::vector<std::string> labelVector);
 std::vector<std::string> setupLabels();
 std::string joinLabels(const std::vector<std::string> &strings);
-std::tuple<double, double> getTemperatureAndHumidity();
+double collectTemperature();
+double collectHumidity();
 
 
 // I2C Bus & Temp/Humitity sensor
@@ -53,27 +62,27 @@ int64_t last_remote_write_unix_ms = 0;
 // int to count remote write failures
 int remote_write_failures = 0;
 
-// The write request that will be used to send the metrics to Prometheus. For every Histogram you need to add 3 + number of buckets timeseries
-WriteRequest req(23, 12288);
+// last humidity read together with the temperature by collectTemperature()
+double last_humidity = 0;
 
-// TimeSeries and labels
+// Metrics and labels
 const char *labels;
 Prometheus_Histogram *coffees_consumed = nullptr;
-TimeSeries *system_memory_free_bytes = nullptr;
-TimeSeries *system_memory_total_bytes = nullptr;
-TimeSeries *system_network_wifi_rssi = nullptr;
-TimeSeries *system_largest_heap_block_size_bytes = nullptr;
-TimeSeries *system_run_time_ms = nullptr;
-TimeSeries *system_remote_write_failures_count = nullptr;
-TimeSeries *system_cpu_temperature = nullptr;
-TimeSeries *system_cpu_clock = nullptr;
-TimeSeries *temperature = nullptr;
-TimeSeries *humidity = nullptr;
+Prometheus_Summary *brew_duration = nullptr;
+Prometheus_Histogram *wifi_connect_duration = nullptr;
+const double brew_duration_quantiles[] = {0.5, 0.9, 0.99};
+MetricRegistry *metrics = nullptr;
 
 // helper services
-hw_timer_t *timer0 = timerBegin(0, 80, true); // timer 0 of esp32 for vibration detection
 Vibration *vibration = nullptr;
 Transport *transport = nullptr;
+RemoteWriteFanout *fanout = nullptr;
+MemoryGovernor *governor = nullptr;
+
+// Text output while ENABLE_TELEMETRY is set, log lines and debug output are sent as text frames
+TelemetryStream log_telemetry_stream;
+TelemetryStream debug_telemetry_stream;
+Stream *console = &Serial;
 
 void setup()
 {
@@ -86,45 +95,57 @@ void setup()
   Serial.begin(SERIAL_BAUD);
   while (!Serial)
     ;
+  if (ENABLE_TELEMETRY)
+  {
+    Telemetry::beginAsync(Serial);
+    console = &debug_telemetry_stream;
+    Log::beginAsync(log_telemetry_stream);
+  }
+  else
+  {
+    Log::beginAsync(Serial);
+  }
 
-  Serial.println("Starting up coffee counter ...");
-  Serial.println("WiFi SSID: " + String(WIFI_SSID));
+  LOG_INFO("Starting up coffee counter ...");
+  LOG_INFO("WiFi SSID: %s", WIFI_SSID);
 
   std::vector<std::string> labelVector = setupLabels();
-  std::string labelString = joinLabels(labelVector);
+  // static, so labels stay valid for the deferred log
+  static std::string labelString = joinLabels(labelVector);
   labels = labelString.c_str();
 
-  if (DEBUG)
-    Serial.println("Labels: " + String(labels));
+  LOG_DEBUG("Labels: %s", labels);
 
   // TimeSeries that hold 10 samples. Make sure to set sample_ingestation rate and remote_write_interval accordingly
   coffees_consumed = new Prometheus_Histogram("CMI_coffees_consumed", labels, TIME_SERIES_SAMPLE_COUNT, 12000, 4000, 10);
-  system_memory_free_bytes = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_memory_free_bytes", labels);
-  system_memory_total_bytes = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_memory_total_bytes", labels);
-  system_network_wifi_rssi = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_network_wifi_rssi", labels);
-  system_cpu_temperature = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_cpu_temperature_celsius", labels);
-  system_cpu_clock = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_cpu_clock_mhz", labels);
-  system_largest_heap_block_size_bytes = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_largest_heap_block_size_bytes", labels);
-  system_run_time_ms = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_run_time_ms", labels);
-  system_remote_write_failures_count = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "ESP32_system_remote_write_failures_count", labels);
-
-  // Add system metrics to the write request
-  req.addTimeSeries(*system_memory_free_bytes);
-  req.addTimeSeries(*system_memory_total_bytes);
-  req.addTimeSeries(*system_network_wifi_rssi);
-  req.addTimeSeries(*system_largest_heap_block_size_bytes);
-  req.addTimeSeries(*system_run_time_ms);
-  req.addTimeSeries(*system_remote_write_failures_count);
-  req.addTimeSeries(*system_cpu_temperature);
-  req.addTimeSeries(*system_cpu_clock);
+  brew_duration = new Prometheus_Summary("CMI_coffee_brew_duration_ms", labels, TIME_SERIES_SAMPLE_COUNT, brew_duration_quantiles, 3,
+                                         BREW_DURATION_WINDOW_SECONDS, BREW_DURATION_WINDOW_SLICES, BREW_DURATION_COMPRESSION);
+  metrics = new MetricRegistry(labels, TIME_SERIES_SAMPLE_COUNT, METRIC_REGISTRY_CAPACITY);
+
+  // System metrics, one line per gauge. Aggregated gauges are sampled every GAUGE_SAMPLING_INTERVAL_MS and exported
+  // with their last sample under their own name and as _min, _max and _avg since the last ingestion. Low priority gauges are shed under memory pressure
+  governor = new MemoryGovernor(*metrics, GAUGE_SAMPLING_INTERVAL_MS);
+  uint32_t heap_before_gauges = ESP.getFreeHeap();
+  metrics->addAggregatedGauge("ESP32_system_memory_free_bytes", []() -> double { return ESP.getFreeHeap(); });
+  metrics->addGauge("ESP32_system_memory_total_bytes", []() -> double { return ESP.getHeapSize(); }, METRIC_PRIORITY_LOW);
+  metrics->addAggregatedGauge("ESP32_system_network_wifi_rssi", []() -> double { return WiFi.RSSI(); });
+  metrics->addAggregatedGauge("ESP32_system_largest_heap_block_size_bytes", []() -> double { return ESP.getMaxAllocHeap(); });
+  metrics->addGauge("ESP32_system_run_time_ms", []() -> double { return run_time_ms; });
+  metrics->addGauge("ESP32_system_remote_write_failures_count", []() -> double { return remote_write_failures + fanout->getFailures(); });
+  metrics->addAggregatedGauge("ESP32_system_cpu_temperature_celsius", []() -> double { return (temprature_sens_read() - 32) / 1.8; }, METRIC_PRIORITY_LOW);
+  metrics->addGauge("ESP32_system_cpu_clock_mhz", []() -> double { return getCpuFrequencyMhz(); }, METRIC_PRIORITY_LOW);
+  metrics->addGauge("ESP32_system_wifi_fast_connect_failures_count", []() -> double { return transport->getWifiFastConnectFailures(); }, METRIC_PRIORITY_LOW);
+  metrics->addGauge("ESP32_system_log_dropped_messages_count", []() -> double { return Log::getDropped(); }, METRIC_PRIORITY_LOW);
+  metrics->addAggregatedGauge("ESP32_system_memory_pressure_stage", []() -> double { return governor->getStage(); });
+  metrics->addGauge("ESP32_system_memory_pressure_transitions_count", []() -> double { return governor->getTransitions(); });
+  LOG_DEBUG("System gauges use %u bytes of heap", heap_before_gauges - ESP.getFreeHeap());
 
   // Setup temperature and humidity sensor with metric if enabled
   if (ENABLE_REV2_SENSORS)
   {
-    temperature = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "coffee_counter_temperature", labels);
-    humidity = new TimeSeries(TIME_SERIES_SAMPLE_COUNT, "coffee_counter_humidity", labels);
-    req.addTimeSeries(*temperature);
-    req.addTimeSeries(*humidity);
+    // temperature must be registered before humidity, since it reads the sensor for both
+    metrics->addGauge("coffee_counter_temperature", collectTemperature);
+    metrics->addGauge("coffee_counter_humidity", collectHumidity);
 
     wire.setPins(WIRE_PIN_SDA, WIRE_PIN_SCL);
     wire.begin();
@@ -134,22 +155,37 @@ void setup()
   }
 
   // setup background task for vibration detection
-  vibration = new Vibration(timer0, MOTION_DETECTION_DURATION_THREASHOLD_SECONDS * 1000, coffees_consumed);
+  vibration = new Vibration(MOTION_DETECTION_DURATION_THREASHOLD_SECONDS * 1000, coffees_consumed, brew_duration);
   vibration->beginAsync();
 
-  // init coffees_consumed histogram
-  coffees_consumed->init(req);
+  // init coffees_consumed histogram and brew_duration summary
+  metrics->addHistogram(coffees_consumed);
+  metrics->addSummary(brew_duration);
+
+  // Wifi reconnect durations, 500ms to 4500ms
+  wifi_connect_duration = new Prometheus_Histogram("ESP32_system_wifi_connect_duration_ms", labels, TIME_SERIES_SAMPLE_COUNT, 500, 1000, 5);
+  metrics->addHistogram(wifi_connect_duration);
 
-  // setup transportation to Grafana Cloud
+  // Remote Write endpoints, each with its own queue and send duration histogram
+  fanout = new RemoteWriteFanout(*metrics, 2);
+  fanout->addEndpoint(setupEndpoint("grafana_cloud", GC_URL, GC_PORT, GC_PATH, grafanaCert, GC_USER, GC_PASS, GC_REMOTE_WRITE_VERSION, labelVector));
+  if (ONPREM_ENABLED)
+  {
+    fanout->addEndpoint(setupEndpoint("onprem", ONPREM_URL, ONPREM_PORT, ONPREM_PATH, ONPREM_CA, ONPREM_USER, ONPREM_PASS, ONPREM_REMOTE_WRITE_VERSION, labelVector));
+  }
+
+  metrics->beginSampling(GAUGE_SAMPLING_INTERVAL_MS);
+
+  // setup Wifi connection and time
   transport = new Transport(WIFI_STATUS_LED_VCC, WIFI_SSID, WIFI_PASSWORD);
-  transport->setEndpoint(GC_PORT, GC_URL, (char *)GC_PATH);
-  transport->setCredentials(GC_USER, GC_PASS);
+  transport->setConnectDurationHistogram(wifi_connect_duration);
   if (DEBUG)
   {
-    req.setDebug(Serial);
-    transport->setDebug(Serial);
+    transport->setDebug(*console);
   }
+  governor->setTransport(transport);
   transport->beginAsync();
+  fanout->beginAsync();
 
   // Set all time variables to the current startup time
   start_time_unix_ms = transport->getTimeMillis();
@@ -158,14 +194,14 @@ void setup()
 
   // set lower CPU lock to reduce power consumtion and heat
   setCpuFrequencyMhz(80);
-  Serial.println("Clock speed set to " + String(getCpuFrequencyMhz()) + "Mhz");
+  LOG_INFO("Clock speed set to %dMhz", getCpuFrequencyMhz());
 
-  if (DEBUG)
-    Serial.println("Startup done");
+  LOG_DEBUG("Startup done");
 };
 
 void loop()
 {
+  Trace::record(TraceEvent::TaskBegin, TRACE_SPAN_MAIN_LOOP);
   if (ENABLE_REV2_SENSORS)
   {
     digitalWrite(SYS_STATUS_LED_VCC, LOW); // low indicates that the main thread is busy, rev2 only
@@ -174,13 +210,36 @@ void loop()
   current_cicle_start_time_unix_ms = transport->getTimeMillis();
   run_time_ms = current_cicle_start_time_unix_ms - start_time_unix_ms;
 
+  governor->update(ESP.getFreeHeap(), ESP.getMaxAllocHeap());
+
   handleSampleIngestion();
   handleMetricsSend();
 
   digitalWrite(SYS_STATUS_LED_VCC, HIGH);
+  Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_MAIN_LOOP);
+
+  // dump the trace buffer on request
+  if (ENABLE_TRACE && Serial.available() > 0 && Serial.read() == 't')
+  {
+    Trace::dump(*console);
+  }
   vTaskDelay(4000 / portTICK_PERIOD_MS);
 }
 
+RemoteWriteEndpoint *setupEndpoint(const char *name, const char *host, uint16_t port, const char *path, const char *ca_cert,
+                                   const char *user, const char *pass, uint8_t remote_write_version, std::vector<std::string> labelVector)
+{
+  RemoteWriteEndpoint *endpoint = new RemoteWriteEndpoint(name, host, port, path, ca_cert, user, pass, remote_write_version);
+
+  // Send durations, 500ms to 3500ms
+  labelVector.push_back("endpoint=\"" + std::string(name) + "\"");
+  std::string endpointLabels = joinLabels(labelVector);
+  Prometheus_Histogram *send_duration = new Prometheus_Histogram("ESP32_system_remote_write_send_duration_ms", endpointLabels.c_str(), TIME_SERIES_SAMPLE_COUNT, 500, 1000, 4);
+  metrics->addHistogram(send_duration);
+  endpoint->setSendDurationHistogram(send_duration);
+  return endpoint;
+}
+
 std::vector<std::string> setupLabels()
 {
   char instanceLabel[25];
@@ -213,26 +272,24 @@ std::string joinLabels(const std::vector<std::string> &strings)
 void handleMetricsSend()
 {
   int64_t next_remote_write_ms = last_remote_write_unix_ms + (REMOTE_WRITE_INTERVAL_SECONDS * 1000) - current_cicle_start_time_unix_ms;
-  if (next_remote_write_ms > 0)
+  // under memory pressure, send every ingestion right away instead of letting samples pile up
+  bool flush_early = governor->shouldFlushEarly() && last_metric_ingestion_unix_ms > last_remote_write_unix_ms;
+  if (next_remote_write_ms > 0 && !flush_early)
   {
-    if (DEBUG)
-      Serial.println("Next remote write in " + String(next_remote_write_ms / 1000) + " seconds");
+    LOG_DEBUG("Next remote write in %d seconds", next_remote_write_ms / 1000);
     return;
   }
 
-  if (DEBUG)
-    Serial.println("Performing remote write");
+  LOG_DEBUG("Performing remote write");
 
   bool success = performRemoteWrite();
   if (!success)
   {
     remote_write_failures++;
-    if (DEBUG)
-      Serial.println("Remote Write failed");
+    LOG_DEBUG("Remote Write failed");
     return;
   }
-  if (DEBUG)
-    Serial.println("Remote Write successful");
+  LOG_DEBUG("Remote Write successful");
   last_remote_write_unix_ms = transport->getTimeMillis();
 }
 
@@ -241,74 +298,36 @@ void handleSampleIngestion()
   int64_t next_ingestion_ms = last_metric_ingestion_unix_ms + (METRICS_INGESTION_RATE_SECONDS * 1000) - current_cicle_start_time_unix_ms;
   if (next_ingestion_ms > 0)
   {
-    if (DEBUG)
-      Serial.println("Next metric ingestion in " + String(next_ingestion_ms / 1000) + " seconds");
+    LOG_DEBUG("Next metric ingestion in %d seconds", next_ingestion_ms / 1000);
     return;
   }
-  if (DEBUG)
-    Serial.println("Ingesting metrics");
-
-  coffees_consumed->Ingest(current_cicle_start_time_unix_ms);
-  ingestMetricSample(*system_memory_free_bytes, current_cicle_start_time_unix_ms, ESP.getFreeHeap(), "free_heap_bytes");
-  ingestMetricSample(*system_memory_total_bytes, current_cicle_start_time_unix_ms, ESP.getHeapSize(), "total_heap_bytes");
-  ingestMetricSample(*system_network_wifi_rssi, current_cicle_start_time_unix_ms, WiFi.RSSI(), "wifi_rssi");
-  ingestMetricSample(*system_largest_heap_block_size_bytes, current_cicle_start_time_unix_ms, ESP.getMaxAllocHeap(), "largest_heap_block_bytes");
-  ingestMetricSample(*system_run_time_ms, current_cicle_start_time_unix_ms, run_time_ms, "run_time_ms");
-  ingestMetricSample(*system_remote_write_failures_count, current_cicle_start_time_unix_ms, remote_write_failures, "remote_write_failures_count");
-  ingestMetricSample(*system_cpu_temperature, current_cicle_start_time_unix_ms, (temprature_sens_read()-32)/1.8, "cpu_temperature_celsius");
-  ingestMetricSample(*system_cpu_clock, current_cicle_start_time_unix_ms, getCpuFrequencyMhz(), "cpu_clock_mhz");
+  LOG_DEBUG("Ingesting metrics");
 
-  if (ENABLE_REV2_SENSORS)
-  {
-    double temp, hum;
-    std::tie(temp, hum) = getTemperatureAndHumidity();
-    ingestMetricSample(*temperature, current_cicle_start_time_unix_ms, temp, "temperature");
-    ingestMetricSample(*humidity, current_cicle_start_time_unix_ms, hum, "humidity");
-  }
+  metrics->Ingest(current_cicle_start_time_unix_ms);
   last_metric_ingestion_unix_ms = transport->getTimeMillis();
 }
 
-void ingestMetricSample(TimeSeries &ts, int64_t timestamp, double value, String name)
+double collectTemperature()
 {
-  if (ts.addSample(timestamp, value))
-  {
-    if (DEBUG)
-      Serial.println("Ingesting metrics for " + name + ": " + String(value) + " at " + String(timestamp));
-  }
-  else
-  {
-    Serial.println("Ingesting metrics: Failed to add sample" + String(ts.errmsg));
-  }
+  sht31->readSample();
+  double temperature = sht31->getTemperature();
+  last_humidity = sht31->getHumidity();
+  LOG_DEBUG("Temperature: %.2f Humidity: %.2f at %d ms", temperature, last_humidity, transport->getTimeMillis());
+  return temperature;
 }
 
-std::tuple<double, double> getTemperatureAndHumidity()
-
+double collectHumidity()
 {
-  sht31->readSample();
-  double temperature = sht31->getTemperature();
-  double humidity = sht31->getHumidity();
-  if (DEBUG)
-    Serial.println("Temperature: " + String(temperature) + " Humidity: " + String(humidity) + " at " + String(transport->getTimeMillis()) + " ms");
-  return std::make_tuple(temperature, humidity);
+  return last_humidity;
 }
 
 bool performRemoteWrite()
 {
-  PromClient::SendResult res = transport->send(req);
-  if (!res == PromClient::SendResult::SUCCESS)
+  // The endpoints send asynchronously from their own queues, the samples are in the payload now
+  if (!fanout->push())
   {
     return false;
   }
-  coffees_consumed->resetSamples();
-  system_memory_free_bytes->resetSamples();
-  system_memory_total_bytes->resetSamples();
-  system_network_wifi_rssi->resetSamples();
-  system_largest_heap_block_size_bytes->resetSamples();
-  system_run_time_ms->resetSamples();
-  system_remote_write_failures_count->resetSamples();
-  system_cpu_temperature->resetSamples();
-  system_cpu_clock->resetSamples();
-  temperature->resetSamples();
-  humidity->resetSamples();
+  metrics->resetSamples();
   return true;
 }
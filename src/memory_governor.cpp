@@ -0,0 +1,86 @@
+#include "memory_governor.h"
+
+// Thresholds in bytes to enter a stage, indexed by MemoryPressureStage
+static const uint32_t free_heap_thresholds[] = {0, MEMORY_STAGE_QUIET_FREE_HEAP_BYTES, MEMORY_STAGE_SLOW_SAMPLING_FREE_HEAP_BYTES,
+                                                MEMORY_STAGE_SHED_FREE_HEAP_BYTES, MEMORY_STAGE_FLUSH_FREE_HEAP_BYTES};
+static const uint32_t largest_block_thresholds[] = {0, MEMORY_STAGE_QUIET_LARGEST_BLOCK_BYTES, MEMORY_STAGE_SLOW_SAMPLING_LARGEST_BLOCK_BYTES,
+                                                    MEMORY_STAGE_SHED_LARGEST_BLOCK_BYTES, MEMORY_STAGE_FLUSH_LARGEST_BLOCK_BYTES};
+
+/// @param sampling_interval_ms Sampling interval of the aggregated gauges without memory pressure.
+MemoryGovernor::MemoryGovernor(MetricRegistry &metrics, uint32_t sampling_interval_ms)
+    : metrics(metrics), sampling_interval_ms(sampling_interval_ms)
+{
+}
+
+/// @brief The debug output of the transport is muted from MEMORY_STAGE_QUIET on.
+void MemoryGovernor::setTransport(Transport *transport)
+{
+    this->transport = transport;
+}
+
+/// @brief Moves to the stage matching the current heap readings. Call periodically, e.g. from the main loop.
+/// @return the stage after the update.
+MemoryPressureStage MemoryGovernor::update(uint32_t free_heap, uint32_t largest_block)
+{
+    MemoryPressureStage previous = stage;
+    MemoryPressureStage next = stageFor(free_heap, largest_block, 0);
+    if (next < previous)
+    {
+        // recover one stage at a time and only with some headroom, so the stage does not flap
+        next = stageFor(free_heap, largest_block, MEMORY_GOVERNOR_HYSTERESIS_BYTES) < previous ? (MemoryPressureStage)(previous - 1) : previous;
+    }
+    if (next != previous)
+    {
+        stage = next;
+        transitions++;
+        LOG_INFO("Memory pressure stage %d -> %d, free heap %d bytes, largest block %d bytes", previous, next, free_heap, largest_block);
+        Telemetry::event(TELEMETRY_EVENT_MEMORY_STAGE, next);
+        apply(previous);
+    }
+    return next;
+}
+
+MemoryPressureStage MemoryGovernor::getStage()
+{
+    return stage;
+}
+
+/// @brief Number of stage changes since startup, in both directions.
+uint32_t MemoryGovernor::getTransitions()
+{
+    return transitions;
+}
+
+/// @brief true if samples should be sent after every ingestion instead of every REMOTE_WRITE_INTERVAL_SECONDS.
+bool MemoryGovernor::shouldFlushEarly()
+{
+    return stage >= MEMORY_STAGE_FLUSH;
+}
+
+/// @brief Highest stage for which one of the readings is below its threshold plus margin.
+MemoryPressureStage MemoryGovernor::stageFor(uint32_t free_heap, uint32_t largest_block, uint32_t margin)
+{
+    for (int i = MEMORY_STAGE_FLUSH; i > MEMORY_STAGE_NORMAL; i--)
+    {
+        if (free_heap < free_heap_thresholds[i] + margin || largest_block < largest_block_thresholds[i] + margin)
+        {
+            return (MemoryPressureStage)i;
+        }
+    }
+    return MEMORY_STAGE_NORMAL;
+}
+
+/// @brief Applies the measures of the current stage and undoes those of the stages above it.
+void MemoryGovernor::apply(MemoryPressureStage previous)
+{
+    Log::setLevel(stage >= MEMORY_STAGE_QUIET ? LOG_LEVEL_INFO : LOG_LEVEL);
+    if (transport != nullptr && (stage >= MEMORY_STAGE_QUIET) != (previous >= MEMORY_STAGE_QUIET))
+    {
+        transport->setDebugMuted(stage >= MEMORY_STAGE_QUIET);
+    }
+    if ((stage >= MEMORY_STAGE_SLOW_SAMPLING) != (previous >= MEMORY_STAGE_SLOW_SAMPLING))
+    {
+        metrics.setSamplingInterval(stage >= MEMORY_STAGE_SLOW_SAMPLING ? sampling_interval_ms * MEMORY_GOVERNOR_SAMPLING_DIVIDER : sampling_interval_ms);
+    }
+    metrics.setMinimumPriority(stage >= MEMORY_STAGE_SHED ? METRIC_PRIORITY_NORMAL : METRIC_PRIORITY_LOW);
+}
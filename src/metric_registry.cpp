@@ -0,0 +1,416 @@
+#include "metric_registry.h"
+
+MetricRegistry::MetricRegistry(const char *labels, int16_t series_size, int16_t capacity)
+    : labels(labels), series_size(series_size), capacity(capacity)
+{
+    gauge_series = new MetricSeries *[capacity];
+    gauge_collectors = new MetricCollector[capacity];
+    gauge_names = new const char *[capacity];
+    gauge_telemetry_ids = new uint16_t[capacity];
+    gauge_priorities = new MetricPriority[capacity];
+    histograms = new Prometheus_Histogram *[capacity];
+    summaries = new Prometheus_Summary *[capacity];
+    aggregate_collectors = new MetricCollector[capacity];
+    aggregate_names = new const char *[capacity];
+    aggregate_telemetry_ids = new uint16_t[capacity];
+    aggregate_priorities = new MetricPriority[capacity];
+    aggregate_last_series = new MetricSeries *[capacity];
+    aggregate_min_series = new MetricSeries *[capacity];
+    aggregate_max_series = new MetricSeries *[capacity];
+    aggregate_avg_series = new MetricSeries *[capacity];
+    aggregate_last = new double[capacity];
+    aggregate_min = new double[capacity];
+    aggregate_max = new double[capacity];
+    aggregate_sum = new double[capacity];
+    aggregate_samples = new uint32_t[capacity];
+    for (int i = 0; i < capacity; i++)
+    {
+        gauge_series[i] = nullptr;
+        gauge_collectors[i] = nullptr;
+        gauge_names[i] = nullptr;
+        histograms[i] = nullptr;
+        summaries[i] = nullptr;
+    }
+}
+
+MetricRegistry::~MetricRegistry()
+{
+    for (int i = 0; i < gauge_count; i++)
+    {
+        delete gauge_series[i];
+    }
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        delete aggregate_last_series[i];
+        delete aggregate_min_series[i];
+        delete aggregate_max_series[i];
+        delete aggregate_avg_series[i];
+    }
+    if (sampling_task != NULL)
+    {
+        vTaskDelete(sampling_task);
+    }
+    delete[] gauge_series;
+    delete[] gauge_collectors;
+    delete[] gauge_names;
+    delete[] gauge_telemetry_ids;
+    delete[] gauge_priorities;
+    delete[] histograms;
+    delete[] summaries;
+    delete[] aggregate_collectors;
+    delete[] aggregate_names;
+    delete[] aggregate_telemetry_ids;
+    delete[] aggregate_priorities;
+    delete[] aggregate_last_series;
+    delete[] aggregate_min_series;
+    delete[] aggregate_max_series;
+    delete[] aggregate_avg_series;
+    delete[] aggregate_last;
+    delete[] aggregate_min;
+    delete[] aggregate_max;
+    delete[] aggregate_sum;
+    delete[] aggregate_samples;
+    delete[] sample_timestamps;
+    delete[] sample_values;
+}
+
+/// @brief Grows the sample blocks by new_series slices and moves the samples of the registered series.
+/// Gauges are registered once at setup, so the blocks end up exactly as large as needed.
+/// @return Index of the first new slice.
+int16_t MetricRegistry::growSamples(int16_t new_series)
+{
+    size_t slots = (size_t)(sample_series_count + new_series) * series_size;
+    int64_t *timestamps = new int64_t[slots];
+    double *values = new double[slots];
+    int16_t slice = 0;
+    for (int i = 0; i < gauge_count; i++, slice++)
+    {
+        gauge_series[i]->moveSamples(timestamps + slice * series_size, values + slice * series_size);
+    }
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        MetricSeries *series[] = {aggregate_last_series[i], aggregate_min_series[i], aggregate_max_series[i], aggregate_avg_series[i]};
+        for (MetricSeries *s : series)
+        {
+            s->moveSamples(timestamps + slice * series_size, values + slice * series_size);
+            slice++;
+        }
+    }
+    delete[] sample_timestamps;
+    delete[] sample_values;
+    sample_timestamps = timestamps;
+    sample_values = values;
+    sample_series_count += new_series;
+    return slice;
+}
+
+/// @brief Registers a gauge whose value is read from the collector on every ingestion.
+/// Must not be called after beginSampling, since the samples of all gauges may move.
+/// @return false if the registry is full.
+bool MetricRegistry::addGauge(const char *name, MetricCollector collector, MetricPriority priority)
+{
+    if (gauge_count >= capacity)
+    {
+        LOG_ERROR("MetricRegistry: capacity exceeded, cannot add %s", name);
+        return false;
+    }
+    int16_t slice = growSamples(1);
+    gauge_series[gauge_count] = new MetricSeries(series_size, name, labels, sample_timestamps + slice * series_size, sample_values + slice * series_size);
+    gauge_collectors[gauge_count] = collector;
+    gauge_names[gauge_count] = name;
+    gauge_telemetry_ids[gauge_count] = Telemetry::registerName(TelemetryKind::Gauge, name);
+    gauge_priorities[gauge_count] = priority;
+    gauge_count++;
+    return true;
+}
+
+/// @brief Registers a gauge that is sampled on every sampling tick. The last sample is exported as name, the
+/// samples since the last ingestion as name_min, name_max and name_avg.
+/// Must not be called after beginSampling, since the samples of all gauges may move.
+/// @return false if the registry is full.
+bool MetricRegistry::addAggregatedGauge(const char *name, MetricCollector collector, MetricPriority priority)
+{
+    if (aggregate_count >= capacity)
+    {
+        LOG_ERROR("MetricRegistry: capacity exceeded, cannot add %s", name);
+        return false;
+    }
+    std::string series_name = name;
+    int16_t slice = growSamples(4);
+    int64_t *timestamps = sample_timestamps + slice * series_size;
+    double *values = sample_values + slice * series_size;
+    aggregate_last_series[aggregate_count] = new MetricSeries(series_size, name, labels, timestamps, values);
+    aggregate_min_series[aggregate_count] = new MetricSeries(series_size, (series_name + "_min").c_str(), labels, timestamps + series_size, values + series_size);
+    aggregate_max_series[aggregate_count] = new MetricSeries(series_size, (series_name + "_max").c_str(), labels, timestamps + 2 * series_size, values + 2 * series_size);
+    aggregate_avg_series[aggregate_count] = new MetricSeries(series_size, (series_name + "_avg").c_str(), labels, timestamps + 3 * series_size, values + 3 * series_size);
+    aggregate_collectors[aggregate_count] = collector;
+    aggregate_names[aggregate_count] = name;
+    aggregate_telemetry_ids[aggregate_count] = Telemetry::registerName(TelemetryKind::Gauge, name);
+    aggregate_priorities[aggregate_count] = priority;
+    aggregate_samples[aggregate_count] = 0;
+    aggregate_count++;
+    return true;
+}
+
+/// @brief Starts a task that samples the aggregated gauges every interval_ms.
+/// The collectors may block, e.g. on I2C or Wi-Fi, so they do not run on the FreeRTOS timer service task.
+/// Telemetry::gauge does not add to that, it drops the record instead of waiting if its queue is full.
+void MetricRegistry::beginSampling(uint32_t interval_ms)
+{
+    if (sampling_task != NULL)
+    {
+        return;
+    }
+    sampling_interval_ms = interval_ms;
+    xTaskCreatePinnedToCore(
+        MetricRegistry::samplingTask,
+        "metric sampling",
+        4096, /* Stack size in words */
+        this,
+        1, /* Priority of the task */
+        &sampling_task,
+        tskNO_AFFINITY);
+}
+
+/// @brief Changes the interval of the running sampling task, starting with the next tick.
+void MetricRegistry::setSamplingInterval(uint32_t interval_ms)
+{
+    sampling_interval_ms = interval_ms;
+    if (sampling_task != NULL)
+    {
+        // restart the wait with the new interval
+        xTaskNotifyGive(sampling_task);
+    }
+}
+
+/// @brief Gauges below the priority are neither collected nor ingested until the priority is lowered again.
+/// Their series are left out of the requests, histograms and summaries are always kept.
+void MetricRegistry::setMinimumPriority(MetricPriority priority)
+{
+    minimum_priority = priority;
+}
+
+void MetricRegistry::samplingTask(void *args)
+{
+    MetricRegistry *instance = static_cast<MetricRegistry *>(args);
+    while (true)
+    {
+        // woken early only by setSamplingInterval
+        if (ulTaskNotifyTake(pdTRUE, instance->sampling_interval_ms / portTICK_PERIOD_MS) == 0)
+        {
+            instance->sample();
+        }
+    }
+}
+
+/// @brief Reads all aggregated gauges once and updates their running min/max/sum/count.
+void MetricRegistry::sample()
+{
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        if (aggregate_priorities[i] < minimum_priority)
+        {
+            continue;
+        }
+        // collect outside of the critical section, it may take a while
+        double value = aggregate_collectors[i]();
+        Telemetry::gauge(aggregate_telemetry_ids[i], value);
+        portENTER_CRITICAL(&aggregate_mux);
+        aggregate_last[i] = value;
+        if (aggregate_samples[i] == 0 || value < aggregate_min[i])
+            aggregate_min[i] = value;
+        if (aggregate_samples[i] == 0 || value > aggregate_max[i])
+            aggregate_max[i] = value;
+        aggregate_sum[i] = aggregate_samples[i] == 0 ? value : aggregate_sum[i] + value;
+        aggregate_samples[i]++;
+        portEXIT_CRITICAL(&aggregate_mux);
+    }
+    portENTER_CRITICAL(&aggregate_mux);
+    sampling_ticks++;
+    sampling_time_us += esp_timer_get_time() - start_us;
+    portEXIT_CRITICAL(&aggregate_mux);
+}
+
+/// @brief Registers a histogram and creates its bucket, count and sum series.
+/// @return false if the registry is full.
+bool MetricRegistry::addHistogram(Prometheus_Histogram *histogram)
+{
+    if (histogram_count >= capacity)
+    {
+        LOG_ERROR("MetricRegistry: capacity exceeded, cannot add histogram");
+        return false;
+    }
+    histogram->init();
+    histograms[histogram_count] = histogram;
+    histogram_count++;
+    return true;
+}
+
+/// @brief Registers a summary and creates its quantile, count and sum series.
+/// @return false if the registry is full.
+bool MetricRegistry::addSummary(Prometheus_Summary *summary)
+{
+    if (summary_count >= capacity)
+    {
+        LOG_ERROR("MetricRegistry: capacity exceeded, cannot add summary");
+        return false;
+    }
+    summary->init();
+    summaries[summary_count] = summary;
+    summary_count++;
+    return true;
+}
+
+void MetricRegistry::Ingest(int64_t timestamp)
+{
+    for (int i = 0; i < histogram_count; i++)
+    {
+        histograms[i]->Ingest(timestamp);
+    }
+    for (int i = 0; i < summary_count; i++)
+    {
+        summaries[i]->Ingest(timestamp);
+    }
+    for (int i = 0; i < gauge_count; i++)
+    {
+        if (gauge_priorities[i] < minimum_priority)
+        {
+            continue;
+        }
+        double value = gauge_collectors[i]();
+        Telemetry::gauge(gauge_telemetry_ids[i], value);
+        ingestSample(gauge_series[i], timestamp, value, gauge_names[i], "");
+    }
+
+    if (sampling_ticks > 0)
+        LOG_DEBUG("Sampled aggregated gauges %d times, %d us per tick", sampling_ticks, sampling_time_us / sampling_ticks);
+    portENTER_CRITICAL(&aggregate_mux);
+    sampling_ticks = 0;
+    sampling_time_us = 0;
+    portEXIT_CRITICAL(&aggregate_mux);
+
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        portENTER_CRITICAL(&aggregate_mux);
+        double last = aggregate_last[i];
+        double min = aggregate_min[i];
+        double max = aggregate_max[i];
+        double sum = aggregate_sum[i];
+        uint32_t samples = aggregate_samples[i];
+        aggregate_samples[i] = 0;
+        portEXIT_CRITICAL(&aggregate_mux);
+
+        if (aggregate_priorities[i] < minimum_priority)
+        {
+            continue;
+        }
+        if (samples == 0)
+        {
+            // not sampled since the last ingestion, use the current value
+            last = min = max = sum = aggregate_collectors[i]();
+            samples = 1;
+        }
+        ingestSample(aggregate_last_series[i], timestamp, last, aggregate_names[i], "");
+        ingestSample(aggregate_min_series[i], timestamp, min, aggregate_names[i], "_min");
+        ingestSample(aggregate_max_series[i], timestamp, max, aggregate_names[i], "_max");
+        ingestSample(aggregate_avg_series[i], timestamp, sum / samples, aggregate_names[i], "_avg");
+    }
+}
+
+void MetricRegistry::ingestSample(MetricSeries *series, int64_t timestamp, double value, const char *name, const char *suffix)
+{
+    if (series->addSample(timestamp, value))
+    {
+        LOG_DEBUG("Ingesting metrics for %s%s: %.2f at %d", name, suffix, value, timestamp);
+    }
+    else
+    {
+        LOG_ERROR("Ingesting metrics: Failed to add sample %s", series->errmsg);
+    }
+}
+
+void MetricRegistry::resetSamples()
+{
+    for (int i = 0; i < histogram_count; i++)
+    {
+        histograms[i]->resetSamples();
+    }
+    for (int i = 0; i < summary_count; i++)
+    {
+        summaries[i]->resetSamples();
+    }
+    for (int i = 0; i < gauge_count; i++)
+    {
+        gauge_series[i]->resetSamples();
+    }
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        aggregate_last_series[i]->resetSamples();
+        aggregate_min_series[i]->resetSamples();
+        aggregate_max_series[i]->resetSamples();
+        aggregate_avg_series[i]->resetSamples();
+    }
+}
+
+/// @brief Encodes all registered series with samples as a request of the encoder's protocol version.
+/// @return Length of the encoded request, 0 if it did not fit into the encoder.
+size_t MetricRegistry::encode(RemoteWriteEncoder &encoder)
+{
+    encoder.reset();
+    bool success = true;
+    for (int i = 0; i < histogram_count; i++)
+    {
+        success &= histograms[i]->encode(encoder);
+    }
+    for (int i = 0; i < summary_count; i++)
+    {
+        success &= summaries[i]->encode(encoder);
+    }
+    for (int i = 0; i < gauge_count; i++)
+    {
+        success &= gauge_series[i]->encode(encoder);
+    }
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        success &= aggregate_last_series[i]->encode(encoder);
+        success &= aggregate_min_series[i]->encode(encoder);
+        success &= aggregate_max_series[i]->encode(encoder);
+        success &= aggregate_avg_series[i]->encode(encoder);
+    }
+    size_t length = encoder.finish();
+    if (!success || length == 0)
+    {
+        LOG_ERROR("Remote Write %d.0 encoding failed: %s", encoder.remoteWriteVersion(), encoder.errmsg);
+        return 0;
+    }
+    return length;
+}
+
+/// @brief Upper bound of the length of a request with all series full, in either protocol version.
+/// Only valid once all series are registered.
+size_t MetricRegistry::maxEncodedSize()
+{
+    // the empty first symbol of Remote Write 2.0
+    size_t size = 2;
+    for (int i = 0; i < histogram_count; i++)
+    {
+        size += histograms[i]->maxEncodedSize();
+    }
+    for (int i = 0; i < summary_count; i++)
+    {
+        size += summaries[i]->maxEncodedSize();
+    }
+    for (int i = 0; i < gauge_count; i++)
+    {
+        size += gauge_series[i]->maxEncodedSize();
+    }
+    for (int i = 0; i < aggregate_count; i++)
+    {
+        size += aggregate_last_series[i]->maxEncodedSize();
+        size += aggregate_min_series[i]->maxEncodedSize();
+        size += aggregate_max_series[i]->maxEncodedSize();
+        size += aggregate_avg_series[i]->maxEncodedSize();
+    }
+    return size;
+}
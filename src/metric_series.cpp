@@ -0,0 +1,75 @@
+#include "metric_series.h"
+#include <string.h>
+
+MetricSeries::MetricSeries(uint16_t series_size, const char *name, const char *labels)
+    : name(name), labels(labels), series_size(series_size), owns_samples(true)
+{
+    timestamps = new int64_t[series_size];
+    values = new double[series_size];
+}
+
+/// @param timestamps Slice of at least series_size timestamps, which must outlive the series.
+/// @param values Slice of at least series_size values, which must outlive the series.
+MetricSeries::MetricSeries(uint16_t series_size, const char *name, const char *labels, int64_t *timestamps, double *values)
+    : name(name), labels(labels), series_size(series_size), timestamps(timestamps), values(values), owns_samples(false)
+{
+}
+
+MetricSeries::~MetricSeries()
+{
+    if (owns_samples)
+    {
+        delete[] timestamps;
+        delete[] values;
+    }
+}
+
+/// @brief Copies the samples into new slices of at least series_size entries and keeps storing there.
+void MetricSeries::moveSamples(int64_t *timestamps, double *values)
+{
+    memcpy(timestamps, this->timestamps, count * sizeof(int64_t));
+    memcpy(values, this->values, count * sizeof(double));
+    if (owns_samples)
+    {
+        delete[] this->timestamps;
+        delete[] this->values;
+    }
+    this->timestamps = timestamps;
+    this->values = values;
+    owns_samples = false;
+}
+
+/// @return false if the series already holds series_size samples.
+bool MetricSeries::addSample(int64_t timestamp, double value)
+{
+    if (count >= series_size)
+    {
+        errmsg = "series is full";
+        return false;
+    }
+    timestamps[count] = timestamp;
+    values[count] = value;
+    count++;
+    return true;
+}
+
+void MetricSeries::resetSamples()
+{
+    count = 0;
+}
+
+bool MetricSeries::encode(RemoteWriteEncoder &encoder)
+{
+    // series without samples, e.g. shed gauges, are left out of the request
+    if (count == 0)
+    {
+        return true;
+    }
+    return encoder.addSeries(name.c_str(), labels.c_str(), timestamps, values, count);
+}
+
+/// @brief Upper bound of the encoded size with all series_size samples, see RemoteWriteEncoder::maxSeriesSize().
+size_t MetricSeries::maxEncodedSize()
+{
+    return RemoteWriteEncoder::maxSeriesSize(name.c_str(), labels.c_str(), series_size);
+}
@@ -5,28 +5,29 @@ Prometheus_Histogram::Prometheus_Histogram(const char *name, const char *labels,
 {
     this->name = new char[strlen(name) + 1];
     strcpy(this->name, name);
+    this->telemetry_id = Telemetry::registerName(TelemetryKind::Histogram, this->name);
     this->labels = labels;
     this->series_size = series_size;
     this->buckets_start_value = buckets_start_value;
     this->buckets_value_increment = buckets_value_increment;
 
-    char time_series_count_name[strlen(name) + 6];
-    char time_series_sum_name[strlen(name) + 4];
+    char time_series_count_name[strlen(name) + 7];
+    char time_series_sum_name[strlen(name) + 5];
     strcpy(time_series_count_name, name);
     strcpy(time_series_sum_name, name);
     strcat(time_series_count_name, "_count");
     strcat(time_series_sum_name, "_sum");
 
-    this->time_series_count = new TimeSeries(series_size, time_series_count_name, labels);
-    this->time_series_sum = new TimeSeries(series_size, time_series_sum_name, labels);
+    this->time_series_count = new MetricSeries(series_size, time_series_count_name, labels);
+    this->time_series_sum = new MetricSeries(series_size, time_series_sum_name, labels);
 
     // We need one more bucket for the "+Inf" bucket
     this->bucket_count = bucket_count + 1;
 
-    this->bucket_le_values = new int64_t[bucket_count];
-    this->bucket_counters = new int64_t[bucket_count];
-    time_series_buckets = new TimeSeries *[bucket_count];
-    for (int i = 0; i < bucket_count; i++)
+    this->bucket_le_values = new int64_t[this->bucket_count];
+    this->bucket_counters = new int64_t[this->bucket_count];
+    time_series_buckets = new MetricSeries *[this->bucket_count];
+    for (int i = 0; i < this->bucket_count; i++)
     {
         time_series_buckets[i] = nullptr; // Initialize with nullptr
     }
@@ -35,7 +36,7 @@ Prometheus_Histogram::Prometheus_Histogram(const char *name, const char *labels,
     xSemaphoreGive(update_sem);
 }
 
-void Prometheus_Histogram::init(WriteRequest &req)
+void Prometheus_Histogram::init()
 {
     char time_series_buckets_name[strlen(name) + 8];
     strcpy(time_series_buckets_name, name);
@@ -67,96 +68,112 @@ void Prometheus_Histogram::init(WriteRequest &req)
             }
         }
 
-        if (DEBUG)
-        {
-            String bucket_name = "le=" + String(this->bucket_le_values[i]);
-            if (i == bucket_count - 1)
-            {
-                bucket_name = "le=+Inf";
-            }
-            Serial.println("Initializing bucket " + String(i) + " with " + bucket_name + " and labels " + String(bucket_labels.c_str()));
-        }
+        if (i == bucket_count - 1)
+            LOG_DEBUG("Initializing bucket %d with le=+Inf for histogram %s", i, name);
+        else
+            LOG_DEBUG("Initializing bucket %d with le=%d for histogram %s", i, bucket_le_values[i], name);
 
-        // Initialize the TimeSeries object for the current bucket
-        time_series_buckets[i] = new TimeSeries(series_size, time_series_buckets_name, bucket_labels.c_str());
-        req.addTimeSeries(*time_series_buckets[i]);
+        // Initialize the series for the current bucket
+        time_series_buckets[i] = new MetricSeries(series_size, time_series_buckets_name, bucket_labels.c_str());
     }
-
-    req.addTimeSeries(*time_series_count);
-    req.addTimeSeries(*time_series_sum);
 }
 
 void Prometheus_Histogram::AddValue(int64_t value)
 {
-    if (DEBUG)
-    {
-        Serial.println("Adding value " + String(value) + " to histogram " + String(this->name));
-    }
+    LOG_DEBUG("Adding value %d to histogram %s", value, name);
+    Telemetry::histogram(telemetry_id, value);
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_HISTOGRAM_UPDATE);
     if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
     {
-        bool found = false;
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_HISTOGRAM_UPDATE);
         // Increment all bucket counters for which the value is smaller than the bucket value
         for (int i = 0; i < bucket_count - 1; i++)
         {
             if (value <= bucket_le_values[i])
             {
                 bucket_counters[i] += 1;
-                if (DEBUG)
-                    Serial.println("Incrementing counter of bucket le=" + String(bucket_le_values[i]) + " with new count " + String(bucket_counters[i]) + " for histogram " + String(this->name));
-                found = true;
+                LOG_DEBUG("Incrementing counter of bucket le=%d with new count %d for histogram %s", bucket_le_values[i], bucket_counters[i], name);
             }
         }
-        if (!found)
-        {
-            // Increment the counter for the last bucket (which is labeled with "+Inf")
-            Serial.println("Value " + String(value) + " is larger than all buckets of histogram " + String(this->name) + ", incrementing counter of bucket +Inf");
-            bucket_counters[bucket_count - 1] += 1;
-        }
+        // The last bucket is labeled with "+Inf" and counts every value, so it always equals _count
+        bucket_counters[bucket_count - 1] += 1;
         sum += value;
         count += 1;
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_HISTOGRAM_UPDATE);
         xSemaphoreGive(update_sem);
     }
 }
 
 void Prometheus_Histogram::Ingest(int64_t timestamp)
 {
-    if (DEBUG)
-    {
-        Serial.println("Ingesting histogram " + String(this->name));
-        Serial.println("Histogram " + String(this->name) + " has count " + String(count) + " and sum " + String(sum) + " at " + String(timestamp));
-    }
+    Trace::record(TraceEvent::TaskBegin, TRACE_SPAN_HISTOGRAM_INGEST);
+    LOG_DEBUG("Ingesting histogram %s", name);
 
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_HISTOGRAM_UPDATE);
     if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
     {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_HISTOGRAM_UPDATE);
+        LOG_DEBUG("Histogram %s has count %d and sum %d at %d", name, count, sum, timestamp);
         time_series_sum->addSample(timestamp, sum);
         time_series_count->addSample(timestamp, count);
         for (int i = 0; i < bucket_count; i++)
         {
-            if (DEBUG)
-            {
-                String bucket_name = "le=" + String(this->bucket_le_values[i]);
-                if (i == bucket_count - 1)
-                {
-                    bucket_name = "le=+Inf";
-                }
-                Serial.println("Histogram " + String(this->name) + " bucket " + i + " " + bucket_name + " has count " + String(bucket_counters[i]));
-            }
+            if (i == bucket_count - 1)
+                LOG_DEBUG("Histogram %s bucket %d le=+Inf has count %d", name, i, bucket_counters[i]);
+            else
+                LOG_DEBUG("Histogram %s bucket %d le=%d has count %d", name, i, bucket_le_values[i], bucket_counters[i]);
             time_series_buckets[i]->addSample(timestamp, bucket_counters[i]);
         }
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_HISTOGRAM_UPDATE);
         xSemaphoreGive(update_sem);
     }
+    Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_HISTOGRAM_INGEST);
 }
 
 void Prometheus_Histogram::resetSamples()
 {
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_HISTOGRAM_UPDATE);
     if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
     {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_HISTOGRAM_UPDATE);
         for (int i = 0; i < bucket_count; i++)
         {
             time_series_buckets[i]->resetSamples();
         }
         time_series_sum->resetSamples();
         time_series_count->resetSamples();
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_HISTOGRAM_UPDATE);
         xSemaphoreGive(update_sem);
     }
 }
+
+bool Prometheus_Histogram::encode(RemoteWriteEncoder &encoder)
+{
+    bool success = true;
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_HISTOGRAM_UPDATE);
+    if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
+    {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_HISTOGRAM_UPDATE);
+        for (int i = 0; i < bucket_count; i++)
+        {
+            success &= time_series_buckets[i]->encode(encoder);
+        }
+        success &= time_series_count->encode(encoder);
+        success &= time_series_sum->encode(encoder);
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_HISTOGRAM_UPDATE);
+        xSemaphoreGive(update_sem);
+    }
+    return success;
+}
+
+/// @brief Upper bound of the encoded size of all series with full samples. Names and labels do not change after
+/// init(), so no semaphore is needed.
+size_t Prometheus_Histogram::maxEncodedSize()
+{
+    size_t size = time_series_count->maxEncodedSize() + time_series_sum->maxEncodedSize();
+    for (int i = 0; i < bucket_count; i++)
+    {
+        size += time_series_buckets[i]->maxEncodedSize();
+    }
+    return size;
+}
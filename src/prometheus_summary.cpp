@@ -0,0 +1,175 @@
+#include "prometheus_summary.h"
+#include "config.h"
+
+Prometheus_Summary::Prometheus_Summary(const char *name, const char *labels, int16_t series_size, const double *quantiles, int16_t quantile_count, int32_t window_seconds, int16_t window_count, uint16_t compression)
+{
+    this->name = new char[strlen(name) + 1];
+    strcpy(this->name, name);
+    this->labels = labels;
+    this->series_size = series_size;
+    this->quantiles = quantiles;
+    this->quantile_count = quantile_count;
+    this->window_count = window_count;
+    this->window_slice_ms = (int64_t)window_seconds * 1000 / window_count;
+    this->window_start_ms = esp_timer_get_time() / 1000;
+
+    char time_series_count_name[strlen(name) + 7];
+    char time_series_sum_name[strlen(name) + 5];
+    strcpy(time_series_count_name, name);
+    strcpy(time_series_sum_name, name);
+    strcat(time_series_count_name, "_count");
+    strcat(time_series_sum_name, "_sum");
+
+    this->time_series_count = new MetricSeries(series_size, time_series_count_name, labels);
+    this->time_series_sum = new MetricSeries(series_size, time_series_sum_name, labels);
+
+    time_series_quantiles = new MetricSeries *[quantile_count];
+    for (int i = 0; i < quantile_count; i++)
+    {
+        time_series_quantiles[i] = nullptr;
+    }
+
+    windows = new QuantileSketch *[window_count];
+    for (int i = 0; i < window_count; i++)
+    {
+        windows[i] = new QuantileSketch(compression);
+    }
+    merged = new QuantileSketch(compression);
+
+    update_sem = xSemaphoreCreateBinary();
+    xSemaphoreGive(update_sem);
+}
+
+void Prometheus_Summary::init()
+{
+    for (int i = 0; i < quantile_count; i++)
+    {
+        std::string quantile_labels = labels;
+        size_t closing_brace_pos = quantile_labels.find_last_of('}');
+        if (closing_brace_pos != std::string::npos)
+        {
+            // ,quantile="" plus the longest %g output, e.g. -1.23457e-308
+            char new_label[32];
+            snprintf(new_label, sizeof(new_label), ",quantile=\"%g\"", quantiles[i]);
+            quantile_labels.insert(closing_brace_pos, new_label);
+        }
+
+        LOG_DEBUG("Initializing quantile %.3f for summary %s", quantiles[i], name);
+
+        time_series_quantiles[i] = new MetricSeries(series_size, name, quantile_labels.c_str());
+    }
+
+    LOG_DEBUG("Summary %s uses %d bytes for quantile sketches", name, (window_count + 1) * windows[0]->memoryBytes());
+}
+
+/// @brief Moves the window forward to now_ms, clearing slices that fell out of it. Must hold update_sem.
+void Prometheus_Summary::advanceWindow(int64_t now_ms)
+{
+    if (now_ms - window_start_ms >= window_slice_ms * window_count)
+    {
+        // Nothing was added for the whole window
+        for (int i = 0; i < window_count; i++)
+        {
+            windows[i]->reset();
+        }
+        window_start_ms = now_ms;
+        return;
+    }
+    while (now_ms - window_start_ms >= window_slice_ms)
+    {
+        current_window = (current_window + 1) % window_count;
+        windows[current_window]->reset();
+        window_start_ms += window_slice_ms;
+    }
+}
+
+void Prometheus_Summary::AddValue(int64_t value)
+{
+    LOG_DEBUG("Adding value %d to summary %s", value, name);
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_SUMMARY_UPDATE);
+    if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
+    {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_SUMMARY_UPDATE);
+        advanceWindow(esp_timer_get_time() / 1000);
+        windows[current_window]->add(value);
+        sum += value;
+        count += 1;
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_SUMMARY_UPDATE);
+        xSemaphoreGive(update_sem);
+    }
+}
+
+void Prometheus_Summary::Ingest(int64_t timestamp)
+{
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_SUMMARY_UPDATE);
+    if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
+    {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_SUMMARY_UPDATE);
+        advanceWindow(esp_timer_get_time() / 1000);
+        merged->reset();
+        for (int i = 0; i < window_count; i++)
+        {
+            merged->addSketch(*windows[i]);
+        }
+
+        time_series_sum->addSample(timestamp, sum);
+        time_series_count->addSample(timestamp, count);
+        for (int i = 0; i < quantile_count; i++)
+        {
+            // NaN for an empty window, as exported by the Prometheus client libraries
+            double value = merged->quantile(quantiles[i]);
+            LOG_DEBUG("Summary %s quantile %.3f is %.2f", name, quantiles[i], value);
+            time_series_quantiles[i]->addSample(timestamp, value);
+        }
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_SUMMARY_UPDATE);
+        xSemaphoreGive(update_sem);
+    }
+}
+
+void Prometheus_Summary::resetSamples()
+{
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_SUMMARY_UPDATE);
+    if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
+    {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_SUMMARY_UPDATE);
+        for (int i = 0; i < quantile_count; i++)
+        {
+            time_series_quantiles[i]->resetSamples();
+        }
+        time_series_sum->resetSamples();
+        time_series_count->resetSamples();
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_SUMMARY_UPDATE);
+        xSemaphoreGive(update_sem);
+    }
+}
+
+bool Prometheus_Summary::encode(RemoteWriteEncoder &encoder)
+{
+    bool success = true;
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_SUMMARY_UPDATE);
+    if (xSemaphoreTake(update_sem, portMAX_DELAY) == pdTRUE)
+    {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_SUMMARY_UPDATE);
+        for (int i = 0; i < quantile_count; i++)
+        {
+            success &= time_series_quantiles[i]->encode(encoder);
+        }
+        success &= time_series_count->encode(encoder);
+        success &= time_series_sum->encode(encoder);
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_SUMMARY_UPDATE);
+        xSemaphoreGive(update_sem);
+    }
+    return success;
+}
+
+/// @brief Upper bound of the encoded size of all series with full samples. Names and labels do not change after
+/// init(), so no semaphore is needed.
+size_t Prometheus_Summary::maxEncodedSize()
+{
+    size_t size = time_series_count->maxEncodedSize() + time_series_sum->maxEncodedSize();
+    for (int i = 0; i < quantile_count; i++)
+    {
+        size += time_series_quantiles[i]->maxEncodedSize();
+    }
+    return size;
+}
@@ -0,0 +1,158 @@
+#include "quantile_sketch.h"
+#include <algorithm>
+#include <math.h>
+
+QuantileSketch::QuantileSketch(uint16_t compression)
+    : compression(compression)
+{
+    // The k1 scale function spans compression / 2, and two neighbouring centroids always span more
+    // than 1 after compress(), so at most compression + 1 centroids survive. The rest is the input buffer.
+    centroid_capacity = 2 * compression + 1;
+    centroids = new Centroid[centroid_capacity];
+}
+
+QuantileSketch::~QuantileSketch()
+{
+    delete[] centroids;
+}
+
+void QuantileSketch::add(double value, uint32_t weight)
+{
+    if (weight == 0)
+    {
+        return;
+    }
+    if (centroid_count + buffered_count >= centroid_capacity)
+    {
+        compress();
+    }
+    if (total_weight == 0 || value < min)
+    {
+        min = value;
+    }
+    if (total_weight == 0 || value > max)
+    {
+        max = value;
+    }
+    centroids[centroid_count + buffered_count] = {static_cast<float>(value), weight};
+    buffered_count++;
+    total_weight += weight;
+}
+
+/// @brief Adds all values of another sketch to this one.
+void QuantileSketch::addSketch(QuantileSketch &other)
+{
+    if (other.total_weight == 0)
+    {
+        return;
+    }
+    other.compress();
+    double other_min = other.min;
+    double other_max = other.max;
+    for (int i = 0; i < other.centroid_count; i++)
+    {
+        add(other.centroids[i].mean, other.centroids[i].weight);
+    }
+    min = std::min(min, other_min);
+    max = std::max(max, other_max);
+}
+
+/// @brief Estimates the value at quantile q (0..1) by interpolating between centroid centers.
+/// @return NAN if the sketch is empty.
+double QuantileSketch::quantile(double q)
+{
+    if (total_weight == 0)
+    {
+        return NAN;
+    }
+    if (q <= 0)
+    {
+        return min;
+    }
+    if (q >= 1)
+    {
+        return max;
+    }
+    compress();
+
+    double index = q * total_weight;
+    double previous_center = 0;
+    double previous_mean = min;
+    double weight_so_far = 0;
+    for (int i = 0; i < centroid_count; i++)
+    {
+        double center = weight_so_far + centroids[i].weight / 2.0;
+        if (index < center)
+        {
+            double t = (index - previous_center) / (center - previous_center);
+            return previous_mean + t * (centroids[i].mean - previous_mean);
+        }
+        previous_center = center;
+        previous_mean = centroids[i].mean;
+        weight_so_far += centroids[i].weight;
+    }
+    if (total_weight <= previous_center)
+    {
+        return max;
+    }
+    double t = (index - previous_center) / (total_weight - previous_center);
+    return previous_mean + t * (max - previous_mean);
+}
+
+uint64_t QuantileSketch::count()
+{
+    return total_weight;
+}
+
+void QuantileSketch::reset()
+{
+    centroid_count = 0;
+    buffered_count = 0;
+    total_weight = 0;
+    min = 0;
+    max = 0;
+}
+
+size_t QuantileSketch::memoryBytes()
+{
+    return sizeof(QuantileSketch) + centroid_capacity * sizeof(Centroid);
+}
+
+/// @brief k1 scale function of the t-digest paper, spanning -compression / 4 .. compression / 4.
+double QuantileSketch::scale(double q)
+{
+    return compression / (2 * M_PI) * asin(2 * q - 1);
+}
+
+/// @brief Sorts buffered values into the centroids and merges neighbours while they span at most 1 in scale.
+void QuantileSketch::compress()
+{
+    if (buffered_count == 0)
+    {
+        return;
+    }
+    uint16_t n = centroid_count + buffered_count;
+    std::sort(centroids, centroids + n, [](const Centroid &a, const Centroid &b) { return a.mean < b.mean; });
+
+    uint16_t out = 0;
+    double weight_so_far = 0;
+    double k_left = scale(0);
+    for (uint16_t i = 1; i < n; i++)
+    {
+        double merged_weight = (double)centroids[out].weight + centroids[i].weight;
+        double k_right = scale((weight_so_far + merged_weight) / total_weight);
+        if (k_right - k_left <= 1)
+        {
+            centroids[out].mean += (centroids[i].mean - centroids[out].mean) * centroids[i].weight / merged_weight;
+            centroids[out].weight += centroids[i].weight;
+        }
+        else
+        {
+            weight_so_far += centroids[out].weight;
+            k_left = scale(weight_so_far / total_weight);
+            centroids[++out] = centroids[i];
+        }
+    }
+    centroid_count = out + 1;
+    buffered_count = 0;
+}
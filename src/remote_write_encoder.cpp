@@ -0,0 +1,202 @@
+#include "remote_write_encoder.h"
+#include <string.h>
+
+// Field tags (field number << 3 | wire type), identical in io.prometheus.write.v2 and prometheus (1.0)
+#define TAG_SERIES_SAMPLES 0x12   // TimeSeries.samples = 2, length delimited
+#define TAG_SAMPLE_VALUE 0x09     // Sample.value = 1, 64 bit
+#define TAG_SAMPLE_TIMESTAMP 0x10 // Sample.timestamp = 2, varint
+
+RemoteWriteEncoder::RemoteWriteEncoder(size_t buffer_size)
+    : buffer_size(buffer_size), owns_buffer(true)
+{
+    buffer = new uint8_t[buffer_size];
+}
+
+/// @param buffer Buffer of at least buffer_size bytes, which must outlive the encoder.
+RemoteWriteEncoder::RemoteWriteEncoder(uint8_t *buffer, size_t buffer_size)
+    : buffer(buffer), buffer_size(buffer_size), owns_buffer(false)
+{
+}
+
+RemoteWriteEncoder::~RemoteWriteEncoder()
+{
+    if (owns_buffer)
+    {
+        delete[] buffer;
+    }
+}
+
+/// @brief Upper bound of the encoded size of a series with count samples in either protocol version.
+/// Every label string is counted as a new Remote Write 2.0 symbol and every length as a 2 byte varint.
+size_t RemoteWriteEncoder::maxSeriesSize(const char *name, const char *labels, uint16_t count)
+{
+    size_t label_count = 1;
+    size_t string_bytes = 8 + strlen(name); // __name__
+    if (labels != nullptr)
+    {
+        size_t pairs = 0;
+        for (const char *p = strstr(labels, "=\""); p != nullptr; p = strstr(p + 2, "=\""))
+        {
+            pairs++;
+        }
+        // '=', the quotes and the separator of a label are not encoded. An escaped =" in a value is counted as
+        // a label too, which adds more overhead below than it subtracts here.
+        size_t labels_length = strlen(labels);
+        string_bytes += labels_length > 4 * pairs ? labels_length - 4 * pairs : 0;
+        label_count += pairs;
+    }
+    // 1.0: label message tag and length, name and value tags and lengths
+    // 2.0: two refs, tags and lengths of the name and value symbols
+    size_t label_overhead = 10;
+    // series tag and length, 2.0 labels_refs tag and length
+    size_t series_overhead = 4 + 3;
+    size_t sample_size = 1 + 1 + 1 + 8 + 1 + REMOTE_WRITE_MAX_TIMESTAMP_BYTES;
+    return series_overhead + label_count * label_overhead + string_bytes + count * sample_size;
+}
+
+void RemoteWriteEncoder::reset()
+{
+    position = 0;
+    overflow = false;
+    errmsg = nullptr;
+}
+
+/// @return Length of the encoded request, 0 if anything did not fit.
+size_t RemoteWriteEncoder::finish()
+{
+    if (overflow)
+    {
+        if (errmsg == nullptr)
+        {
+            errmsg = "buffer too small";
+        }
+        return 0;
+    }
+    return position;
+}
+
+const uint8_t *RemoteWriteEncoder::data()
+{
+    return buffer;
+}
+
+size_t RemoteWriteEncoder::length()
+{
+    return overflow ? 0 : position;
+}
+
+/// @brief Splits __name__ and the labels of a series, sorted by label name as both protocol versions require.
+/// @return Number of labels, -1 if there are more than REMOTE_WRITE_MAX_LABELS.
+int RemoteWriteEncoder::parseLabels(const char *name, const char *labels, RemoteWriteLabel *result)
+{
+    result[0] = {"__name__", 8, name, strlen(name)};
+    int label_count = 1;
+
+    const char *p = labels != nullptr ? strchr(labels, '{') : nullptr;
+    while (p != nullptr && *p != '\0' && *p != '}')
+    {
+        p++;
+        const char *key = p;
+        while (*p != '\0' && *p != '=')
+            p++;
+        if (*p != '=' || p[1] != '"')
+            break;
+        size_t key_length = p - key;
+        p += 2;
+        const char *value = p;
+        while (*p != '\0' && !(*p == '"' && p[-1] != '\\'))
+            p++;
+        if (*p != '"')
+            break;
+        size_t value_length = p - value;
+        p++;
+
+        if (label_count >= REMOTE_WRITE_MAX_LABELS)
+        {
+            errmsg = "too many labels";
+            overflow = true;
+            return -1;
+        }
+        int i = label_count;
+        while (i > 0)
+        {
+            size_t common = key_length < result[i - 1].name_length ? key_length : result[i - 1].name_length;
+            int cmp = memcmp(result[i - 1].name, key, common);
+            if (cmp < 0 || (cmp == 0 && result[i - 1].name_length <= key_length))
+                break;
+            result[i] = result[i - 1];
+            i--;
+        }
+        result[i] = {key, key_length, value, value_length};
+        label_count++;
+    }
+    return label_count;
+}
+
+size_t RemoteWriteEncoder::varintSize(uint64_t value)
+{
+    size_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/// @brief Encoded size of the samples field of a series.
+size_t RemoteWriteEncoder::samplesSize(const int64_t *timestamps, uint16_t count)
+{
+    size_t size = 0;
+    for (uint16_t i = 0; i < count; i++)
+    {
+        size_t sample_length = 1 + 8 + 1 + varintSize((uint64_t)timestamps[i]);
+        size += 1 + varintSize(sample_length) + sample_length;
+    }
+    return size;
+}
+
+void RemoteWriteEncoder::writeSamples(const int64_t *timestamps, const double *values, uint16_t count)
+{
+    for (uint16_t i = 0; i < count; i++)
+    {
+        writeByte(TAG_SERIES_SAMPLES);
+        writeVarint(1 + 8 + 1 + varintSize((uint64_t)timestamps[i]));
+        writeByte(TAG_SAMPLE_VALUE);
+        // protobuf doubles are little endian, as is the ESP32
+        writeBytes(&values[i], 8);
+        writeByte(TAG_SAMPLE_TIMESTAMP);
+        writeVarint((uint64_t)timestamps[i]);
+    }
+}
+
+void RemoteWriteEncoder::writeByte(uint8_t value)
+{
+    if (position >= buffer_size)
+    {
+        overflow = true;
+        return;
+    }
+    buffer[position++] = value;
+}
+
+void RemoteWriteEncoder::writeVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        writeByte((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    writeByte((uint8_t)value);
+}
+
+void RemoteWriteEncoder::writeBytes(const void *data, size_t len)
+{
+    if (position + len > buffer_size)
+    {
+        overflow = true;
+        return;
+    }
+    memcpy(buffer + position, data, len);
+    position += len;
+}
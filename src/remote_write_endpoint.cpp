@@ -0,0 +1,224 @@
+#include "remote_write_endpoint.h"
+
+/// @param ca_cert Root certificate of the endpoint. nullptr for plain HTTP.
+/// @param user Basic auth user. nullptr to send without authentication.
+RemoteWriteEndpoint::RemoteWriteEndpoint(const char *name, const char *host, uint16_t port, const char *path, const char *ca_cert, const char *user, const char *pass, uint8_t remote_write_version)
+    : name(name), host(host), port(port), path(path), user(user), pass(pass), remoteWriteVersion(remote_write_version)
+{
+    if (ca_cert != nullptr)
+    {
+        WiFiClientSecure *secure_client = new WiFiClientSecure();
+        secure_client->setCACert(ca_cert);
+        client = secure_client;
+    }
+    else
+    {
+        client = new WiFiClient();
+    }
+    httpClient = new HttpClient(*client, host, port);
+    httpClient->setHttpResponseTimeout(REMOTE_WRITE_RESPONSE_TIMEOUT_MS);
+    queue = xQueueCreate(REMOTE_WRITE_QUEUE_LENGTH, sizeof(RemoteWritePayload *));
+}
+
+RemoteWriteEndpoint::~RemoteWriteEndpoint()
+{
+    if (sendTaskHandle != NULL)
+    {
+        vTaskDelete(sendTaskHandle);
+    }
+    RemoteWritePayload *payload;
+    while (xQueueReceive(queue, &payload, 0) == pdTRUE)
+    {
+        payload->release();
+    }
+    vQueueDelete(queue);
+    delete httpClient;
+    delete client;
+}
+
+void RemoteWriteEndpoint::setSendDurationHistogram(Prometheus_Histogram *send_duration)
+{
+    sendDuration = send_duration;
+}
+
+void RemoteWriteEndpoint::beginAsync()
+{
+    if (sendTaskHandle == NULL)
+    {
+        xTaskCreatePinnedToCore(
+            RemoteWriteEndpoint::sendTask,
+            "remote write",
+            10000, /* Stack size in words */
+            this,
+            2, /* Priority of the task */
+            &sendTaskHandle,
+            tskNO_AFFINITY);
+    }
+}
+
+/// @brief Queues a payload for sending and takes a reference to it. Never blocks.
+void RemoteWriteEndpoint::enqueue(RemoteWritePayload *payload)
+{
+    payload->retain();
+    if (xQueueSend(queue, &payload, 0) == pdTRUE)
+    {
+        return;
+    }
+    // Queue is full, drop the oldest payload to make room
+    RemoteWritePayload *oldest;
+    if (xQueueReceive(queue, &oldest, 0) == pdTRUE)
+    {
+        oldest->release();
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+        LOG_ERROR("Remote Write %s: queue full, dropped oldest payload", name);
+    }
+    if (xQueueSend(queue, &payload, 0) != pdTRUE)
+    {
+        payload->release();
+        __atomic_fetch_add(&failures, 1, __ATOMIC_RELAXED);
+    }
+}
+
+uint8_t RemoteWriteEndpoint::getRemoteWriteVersion()
+{
+    return remoteWriteVersion;
+}
+
+/// @return true once the endpoint accepted a request of its current protocol version.
+bool RemoteWriteEndpoint::isRemoteWriteVersionConfirmed()
+{
+    return remoteWriteVersionConfirmed;
+}
+
+int32_t RemoteWriteEndpoint::getFailures()
+{
+    return __atomic_load_n(&failures, __ATOMIC_RELAXED);
+}
+
+const char *RemoteWriteEndpoint::getName()
+{
+    return name;
+}
+
+void RemoteWriteEndpoint::sendTask(void *args)
+{
+    RemoteWriteEndpoint *instance = static_cast<RemoteWriteEndpoint *>(args);
+    while (true)
+    {
+        RemoteWritePayload *payload;
+        if (xQueueReceive(instance->queue, &payload, portMAX_DELAY) != pdTRUE)
+        {
+            continue;
+        }
+
+        uint32_t backoff_ms = REMOTE_WRITE_RETRY_BACKOFF_MS;
+        for (int attempt = 0; attempt <= REMOTE_WRITE_MAX_RETRIES; attempt++)
+        {
+            while (WiFi.status() != WL_CONNECTED)
+            {
+                vTaskDelay(1000 / portTICK_PERIOD_MS);
+            }
+            if (!instance->matchRemoteWriteVersion(payload))
+            {
+                __atomic_fetch_add(&instance->failures, 1, __ATOMIC_RELAXED);
+                break;
+            }
+
+            int64_t start_ms = esp_timer_get_time() / 1000;
+            PromClient::SendResult res = instance->post(payload);
+            if (instance->sendDuration != nullptr)
+            {
+                instance->sendDuration->AddValue(esp_timer_get_time() / 1000 - start_ms);
+            }
+            if (res == PromClient::SendResult::SUCCESS)
+            {
+                instance->remoteWriteVersionConfirmed = true;
+                break;
+            }
+            __atomic_fetch_add(&instance->failures, 1, __ATOMIC_RELAXED);
+            if (payload->remoteWriteVersion() != instance->remoteWriteVersion)
+            {
+                // the endpoint rejected the protocol version, send the fallback right away
+                attempt--;
+                continue;
+            }
+            if (res == PromClient::SendResult::FAILED_DONT_RETRY)
+            {
+                break;
+            }
+            vTaskDelay(backoff_ms / portTICK_PERIOD_MS);
+            backoff_ms = min(backoff_ms * 2, (uint32_t)REMOTE_WRITE_MAX_BACKOFF_MS);
+        }
+        payload->release();
+    }
+}
+
+/// @brief Replaces a payload encoded for another protocol version, e.g. before a fallback, by its fallback.
+/// @return false if the payload has no fallback for the current version and has to be dropped.
+bool RemoteWriteEndpoint::matchRemoteWriteVersion(RemoteWritePayload *&payload)
+{
+    if (payload->remoteWriteVersion() == remoteWriteVersion)
+    {
+        return true;
+    }
+    RemoteWritePayload *fallback = payload->getFallback();
+    if (fallback == nullptr || fallback->remoteWriteVersion() != remoteWriteVersion)
+    {
+        LOG_ERROR("Remote Write %s: dropped payload without Remote Write %d.0 fallback", name, remoteWriteVersion);
+        return false;
+    }
+    fallback->retain();
+    payload->release();
+    payload = fallback;
+    return true;
+}
+
+PromClient::SendResult RemoteWriteEndpoint::post(RemoteWritePayload *payload)
+{
+    Trace::record(TraceEvent::SendBegin);
+    httpClient->beginRequest();
+    httpClient->post(path);
+    if (payload->remoteWriteVersion() == 2)
+    {
+        httpClient->sendHeader(HTTP_HEADER_CONTENT_TYPE, "application/x-protobuf;proto=io.prometheus.write.v2.Request");
+        httpClient->sendHeader("X-Prometheus-Remote-Write-Version", "2.0.0");
+    }
+    else
+    {
+        httpClient->sendHeader(HTTP_HEADER_CONTENT_TYPE, "application/x-protobuf");
+        httpClient->sendHeader("X-Prometheus-Remote-Write-Version", "0.1.0");
+    }
+    httpClient->sendHeader(HTTP_HEADER_CONTENT_LENGTH, (int)payload->length());
+    httpClient->sendHeader("Content-Encoding", "snappy");
+    if (user != nullptr)
+    {
+        httpClient->sendBasicAuth(user, pass);
+    }
+    httpClient->beginBody();
+    httpClient->write(payload->data(), payload->length());
+    httpClient->endRequest();
+    int status = httpClient->responseStatusCode();
+    Telemetry::event(TELEMETRY_EVENT_REMOTE_WRITE, status);
+    httpClient->skipResponseHeaders();
+    httpClient->stop();
+
+    PromClient::SendResult res = PromClient::SendResult::SUCCESS;
+    if (status == 415 && payload->remoteWriteVersion() == 2)
+    {
+        // Endpoint does not support Remote Write 2.0, send the 1.0 fallback and use 1.0 from now on
+        LOG_INFO("Remote Write %s: 2.0 not supported, falling back to 1.0", name);
+        remoteWriteVersion = 1;
+        res = PromClient::SendResult::FAILED_DONT_RETRY;
+    }
+    else if (status < 200 || status >= 300)
+    {
+        LOG_ERROR("Remote Write %s: failed with status %d", name, status);
+        res = (status >= 400 && status < 500 && status != 429) ? PromClient::SendResult::FAILED_DONT_RETRY : PromClient::SendResult::FAILED_RETRYABLE;
+    }
+    else
+    {
+        LOG_DEBUG("Remote Write %s: sent %d bytes", name, payload->length());
+    }
+    Trace::record(TraceEvent::SendEnd, res);
+    return res;
+}
@@ -0,0 +1,169 @@
+#include "remote_write_fanout.h"
+
+RemoteWriteFanout::RemoteWriteFanout(MetricRegistry &metrics, uint8_t max_endpoints)
+    : metrics(metrics), max_endpoints(max_endpoints)
+{
+    endpoints = new RemoteWriteEndpoint *[max_endpoints];
+}
+
+RemoteWriteFanout::~RemoteWriteFanout()
+{
+    delete[] endpoints;
+}
+
+/// @return false if max_endpoints is reached.
+bool RemoteWriteFanout::addEndpoint(RemoteWriteEndpoint *endpoint)
+{
+    if (endpoint_count >= max_endpoints)
+    {
+        LOG_ERROR("RemoteWriteFanout: cannot add endpoint %s", endpoint->getName());
+        return false;
+    }
+    endpoints[endpoint_count++] = endpoint;
+    return true;
+}
+
+/// @brief Sizes the encode buffer and starts the endpoint tasks.
+/// Must be called after all series, including the send duration histograms of the endpoints, are registered.
+void RemoteWriteFanout::beginAsync()
+{
+    buffer_size = metrics.maxEncodedSize();
+    LOG_DEBUG("Remote Write buffers: up to %d bytes encoded, %d bytes compressed during a push", buffer_size, snappy_max_compressed_length(buffer_size));
+    for (int i = 0; i < endpoint_count; i++)
+    {
+        endpoints[i]->beginAsync();
+    }
+}
+
+/// @brief Encodes the current samples and queues them on all endpoints.
+/// Endpoints that cannot get a payload, e.g. because encoding failed, count it as failure.
+/// Until every Remote Write 2.0 endpoint accepted a request, the 2.0 payload carries the samples encoded as 1.0
+/// too, so they are not lost if an endpoint answers 415 after the samples were reset.
+/// The encode buffer, the snappy state and the compression buffer are freed again before push returns, so they
+/// do not take heap from TLS handshakes between pushes. If they cannot be allocated, all endpoints miss the push.
+/// @return true if at least one endpoint got the payload, so the samples can be reset.
+bool RemoteWriteFanout::push()
+{
+    if (buffer_size == 0)
+    {
+        LOG_ERROR("Remote Write: push before beginAsync");
+        return false;
+    }
+    buffer = new (std::nothrow) uint8_t[buffer_size];
+    if (buffer == nullptr || snappy_init_env(&snappy_env) != 0)
+    {
+        LOG_ERROR("Remote Write: out of memory for encode buffer of %d bytes", buffer_size);
+        delete[] buffer;
+        buffer = nullptr;
+        missed_payloads += endpoint_count;
+        return false;
+    }
+
+    bool queued = false;
+    RemoteWritePayload *payloads[3] = {nullptr, nullptr, nullptr};
+    bool encoded[3] = {false, false, false};
+    bool fallback_needed = false;
+    for (int i = 0; i < endpoint_count; i++)
+    {
+        fallback_needed |= endpoints[i]->getRemoteWriteVersion() == 2 && !endpoints[i]->isRemoteWriteVersionConfirmed();
+    }
+    for (int i = 0; i < endpoint_count; i++)
+    {
+        uint8_t version = endpoints[i]->getRemoteWriteVersion() == 2 ? 2 : 1;
+        if (!encoded[version])
+        {
+            payloads[version] = encode(version);
+            encoded[version] = true;
+            // attached before the 2.0 payload is shared with any endpoint
+            if (version == 2 && fallback_needed && payloads[2] != nullptr)
+            {
+                if (!encoded[1])
+                {
+                    payloads[1] = encode(1);
+                    encoded[1] = true;
+                }
+                if (payloads[1] != nullptr)
+                {
+                    payloads[1]->retain();
+                    payloads[2]->setFallback(payloads[1]);
+                }
+            }
+        }
+        if (payloads[version] == nullptr)
+        {
+            missed_payloads++;
+            continue;
+        }
+        endpoints[i]->enqueue(payloads[version]);
+        queued = true;
+    }
+    // the endpoint queues hold their own references now
+    for (int version = 1; version <= 2; version++)
+    {
+        if (payloads[version] != nullptr)
+        {
+            payloads[version]->release();
+        }
+    }
+    snappy_free_env(&snappy_env);
+    delete[] buffer;
+    buffer = nullptr;
+    return queued;
+}
+
+int32_t RemoteWriteFanout::getFailures()
+{
+    int32_t failures = missed_payloads;
+    for (int i = 0; i < endpoint_count; i++)
+    {
+        failures += endpoints[i]->getFailures();
+    }
+    return failures;
+}
+
+RemoteWritePayload *RemoteWriteFanout::encode(uint8_t remote_write_version)
+{
+    // the encoders share the buffer, the payload of one version is copied out before the next is encoded
+    RemoteWriteEncoder *encoder;
+    if (remote_write_version == 2)
+    {
+        encoder = new RemoteWriteV2Encoder(buffer, buffer_size, REMOTE_WRITE_V2_MAX_SYMBOLS);
+    }
+    else
+    {
+        encoder = new RemoteWriteV1Encoder(buffer, buffer_size);
+    }
+    size_t raw_length = metrics.encode(*encoder);
+    RemoteWritePayload *payload = raw_length == 0 ? nullptr : compress(encoder->data(), raw_length, remote_write_version);
+    delete encoder;
+    return payload;
+}
+
+/// @brief Compresses into a buffer sized for this request instead of the largest possible one and copies
+/// the result into a new payload.
+/// @return nullptr if compression or an allocation failed.
+RemoteWritePayload *RemoteWriteFanout::compress(const uint8_t *data, size_t raw_length, uint8_t remote_write_version)
+{
+    size_t length = snappy_max_compressed_length(raw_length);
+    uint8_t *compressed = new (std::nothrow) uint8_t[length];
+    if (compressed == nullptr)
+    {
+        LOG_ERROR("Remote Write: out of memory for compression buffer of %d bytes", length);
+        return nullptr;
+    }
+    RemoteWritePayload *payload = nullptr;
+    if (snappy_compress(&snappy_env, (const char *)data, raw_length, (char *)compressed, &length) != 0)
+    {
+        LOG_ERROR("Remote Write %d.0: snappy compression failed", remote_write_version);
+    }
+    else
+    {
+        payload = RemoteWritePayload::create(compressed, length, remote_write_version);
+        if (payload == nullptr)
+        {
+            LOG_ERROR("Remote Write: out of memory for payload of %d bytes", length);
+        }
+    }
+    delete[] compressed;
+    return payload;
+}
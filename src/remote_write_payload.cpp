@@ -0,0 +1,74 @@
+#include "remote_write_payload.h"
+
+/// @brief Copies data into a new payload with one reference held by the caller.
+/// @return nullptr if the allocation failed.
+RemoteWritePayload *RemoteWritePayload::create(const uint8_t *data, size_t length, uint8_t remote_write_version)
+{
+    uint8_t *copy = new (std::nothrow) uint8_t[length];
+    if (copy == nullptr)
+    {
+        return nullptr;
+    }
+    memcpy(copy, data, length);
+    RemoteWritePayload *payload = new (std::nothrow) RemoteWritePayload(copy, length, remote_write_version);
+    if (payload == nullptr)
+    {
+        delete[] copy;
+    }
+    return payload;
+}
+
+RemoteWritePayload::RemoteWritePayload(uint8_t *data, size_t length, uint8_t remote_write_version)
+    : payload_data(data), payload_length(length), remote_write_version(remote_write_version)
+{
+}
+
+RemoteWritePayload::~RemoteWritePayload()
+{
+    delete[] payload_data;
+    if (fallback != nullptr)
+    {
+        fallback->release();
+    }
+}
+
+void RemoteWritePayload::retain()
+{
+    __atomic_add_fetch(&references, 1, __ATOMIC_RELAXED);
+}
+
+void RemoteWritePayload::release()
+{
+    if (__atomic_sub_fetch(&references, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        delete this;
+    }
+}
+
+const uint8_t *RemoteWritePayload::data()
+{
+    return payload_data;
+}
+
+size_t RemoteWritePayload::length()
+{
+    return payload_length;
+}
+
+uint8_t RemoteWritePayload::remoteWriteVersion()
+{
+    return remote_write_version;
+}
+
+/// @brief Attaches the same samples encoded for another protocol version and takes over the caller's reference to it.
+/// Must be called before the payload is shared.
+void RemoteWritePayload::setFallback(RemoteWritePayload *fallback)
+{
+    this->fallback = fallback;
+}
+
+/// @return nullptr if the payload has no fallback.
+RemoteWritePayload *RemoteWritePayload::getFallback()
+{
+    return fallback;
+}
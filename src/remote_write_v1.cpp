@@ -0,0 +1,72 @@
+#include "remote_write_v1.h"
+
+// Field tags (field number << 3 | wire type) of prometheus.WriteRequest
+#define TAG_REQUEST_TIMESERIES 0x0a // WriteRequest.timeseries = 1, length delimited
+#define TAG_SERIES_LABELS 0x0a      // TimeSeries.labels = 1, length delimited
+#define TAG_LABEL_NAME 0x0a         // Label.name = 1, length delimited
+#define TAG_LABEL_VALUE 0x12        // Label.value = 2, length delimited
+
+RemoteWriteV1Encoder::RemoteWriteV1Encoder(size_t buffer_size)
+    : RemoteWriteEncoder(buffer_size)
+{
+}
+
+RemoteWriteV1Encoder::RemoteWriteV1Encoder(uint8_t *buffer, size_t buffer_size)
+    : RemoteWriteEncoder(buffer, buffer_size)
+{
+}
+
+/// @brief Adds a series with its samples.
+/// @param labels Labels in the format {name="value",...}. Escape sequences in values are not decoded.
+/// @return false if the buffer or the label limit was exceeded.
+bool RemoteWriteV1Encoder::addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count)
+{
+    if (overflow)
+    {
+        return false;
+    }
+
+    RemoteWriteLabel parsed[REMOTE_WRITE_MAX_LABELS];
+    int label_count = parseLabels(name, labels, parsed);
+    if (label_count < 0)
+    {
+        return false;
+    }
+
+    size_t series_length = samplesSize(timestamps, count);
+    for (int i = 0; i < label_count; i++)
+    {
+        size_t label_length = labelSize(parsed[i]);
+        series_length += 1 + varintSize(label_length) + label_length;
+    }
+
+    writeByte(TAG_REQUEST_TIMESERIES);
+    writeVarint(series_length);
+    for (int i = 0; i < label_count; i++)
+    {
+        writeByte(TAG_SERIES_LABELS);
+        writeVarint(labelSize(parsed[i]));
+        writeByte(TAG_LABEL_NAME);
+        writeVarint(parsed[i].name_length);
+        writeBytes(parsed[i].name, parsed[i].name_length);
+        writeByte(TAG_LABEL_VALUE);
+        writeVarint(parsed[i].value_length);
+        writeBytes(parsed[i].value, parsed[i].value_length);
+    }
+    writeSamples(timestamps, values, count);
+    if (overflow && errmsg == nullptr)
+    {
+        errmsg = "buffer too small";
+    }
+    return !overflow;
+}
+
+uint8_t RemoteWriteV1Encoder::remoteWriteVersion()
+{
+    return 1;
+}
+
+size_t RemoteWriteV1Encoder::labelSize(const RemoteWriteLabel &label)
+{
+    return 1 + varintSize(label.name_length) + label.name_length + 1 + varintSize(label.value_length) + label.value_length;
+}
@@ -0,0 +1,132 @@
+#include "remote_write_v2.h"
+#include <string.h>
+
+// Field tags (field number << 3 | wire type) of io.prometheus.write.v2
+#define TAG_REQUEST_SYMBOLS 0x22     // Request.symbols = 4, length delimited
+#define TAG_REQUEST_TIMESERIES 0x2a  // Request.timeseries = 5, length delimited
+#define TAG_SERIES_LABELS_REFS 0x0a  // TimeSeries.labels_refs = 1, packed
+
+RemoteWriteV2Encoder::RemoteWriteV2Encoder(size_t buffer_size, uint16_t max_symbols)
+    : RemoteWriteEncoder(buffer_size), max_symbols(max_symbols)
+{
+    symbols = new const char *[max_symbols];
+    symbol_lengths = new uint16_t[max_symbols];
+    reset();
+}
+
+RemoteWriteV2Encoder::RemoteWriteV2Encoder(uint8_t *buffer, size_t buffer_size, uint16_t max_symbols)
+    : RemoteWriteEncoder(buffer, buffer_size), max_symbols(max_symbols)
+{
+    symbols = new const char *[max_symbols];
+    symbol_lengths = new uint16_t[max_symbols];
+    reset();
+}
+
+RemoteWriteV2Encoder::~RemoteWriteV2Encoder()
+{
+    delete[] symbols;
+    delete[] symbol_lengths;
+}
+
+void RemoteWriteV2Encoder::reset()
+{
+    RemoteWriteEncoder::reset();
+    // The first symbol must be the empty string
+    symbols[0] = "";
+    symbol_lengths[0] = 0;
+    symbol_count = 1;
+}
+
+/// @brief Adds a series with its samples.
+/// @param labels Labels in the format {name="value",...}. Escape sequences in values are not decoded.
+/// @return false if the buffer, the symbol table or the label limit was exceeded.
+bool RemoteWriteV2Encoder::addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count)
+{
+    if (overflow)
+    {
+        return false;
+    }
+
+    // Resolve label refs, sorted by label name
+    RemoteWriteLabel parsed[REMOTE_WRITE_MAX_LABELS];
+    int label_count = parseLabels(name, labels, parsed);
+    if (label_count < 0)
+    {
+        return false;
+    }
+    uint32_t refs[2 * REMOTE_WRITE_MAX_LABELS];
+    for (int i = 0; i < label_count; i++)
+    {
+        refs[2 * i] = intern(parsed[i].name, parsed[i].name_length);
+        refs[2 * i + 1] = intern(parsed[i].value, parsed[i].value_length);
+    }
+    if (overflow)
+    {
+        return false;
+    }
+
+    size_t refs_length = 0;
+    for (int i = 0; i < 2 * label_count; i++)
+    {
+        refs_length += varintSize(refs[i]);
+    }
+    size_t series_length = 1 + varintSize(refs_length) + refs_length + samplesSize(timestamps, count);
+
+    writeByte(TAG_REQUEST_TIMESERIES);
+    writeVarint(series_length);
+    writeByte(TAG_SERIES_LABELS_REFS);
+    writeVarint(refs_length);
+    for (int i = 0; i < 2 * label_count; i++)
+    {
+        writeVarint(refs[i]);
+    }
+    writeSamples(timestamps, values, count);
+    if (overflow && errmsg == nullptr)
+    {
+        errmsg = "buffer too small";
+    }
+    return !overflow;
+}
+
+/// @brief Appends the symbol table. Protobuf allows fields in any order, so it can follow the series.
+/// @return Length of the encoded request, 0 if anything did not fit.
+size_t RemoteWriteV2Encoder::finish()
+{
+    for (uint16_t i = 0; i < symbol_count; i++)
+    {
+        writeByte(TAG_REQUEST_SYMBOLS);
+        writeVarint(symbol_lengths[i]);
+        writeBytes(symbols[i], symbol_lengths[i]);
+    }
+    return RemoteWriteEncoder::finish();
+}
+
+uint8_t RemoteWriteV2Encoder::remoteWriteVersion()
+{
+    return 2;
+}
+
+uint16_t RemoteWriteV2Encoder::symbolCount()
+{
+    return symbol_count;
+}
+
+uint32_t RemoteWriteV2Encoder::intern(const char *str, size_t len)
+{
+    for (uint16_t i = 0; i < symbol_count; i++)
+    {
+        if (symbol_lengths[i] == len && memcmp(symbols[i], str, len) == 0)
+        {
+            return i;
+        }
+    }
+    if (symbol_count >= max_symbols)
+    {
+        errmsg = "symbol table full";
+        overflow = true;
+        return 0;
+    }
+    symbols[symbol_count] = str;
+    symbol_lengths[symbol_count] = len;
+    return symbol_count++;
+}
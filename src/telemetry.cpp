@@ -0,0 +1,235 @@
+#include "telemetry.h"
+
+// header, the longest payload (a text frame) and the CRC
+#define TELEMETRY_MAX_BODY (6 + TELEMETRY_MAX_TEXT + 2)
+// COBS adds one byte per 254 bytes plus one, the frame ends with a zero delimiter
+#define TELEMETRY_MAX_FRAME (TELEMETRY_MAX_BODY + TELEMETRY_MAX_BODY / 254 + 2)
+
+Stream *Telemetry::stream = nullptr;
+QueueHandle_t Telemetry::queue = NULL;
+SemaphoreHandle_t Telemetry::write_sem = NULL;
+const char *Telemetry::names[TELEMETRY_MAX_NAMES];
+TelemetryKind Telemetry::kinds[TELEMETRY_MAX_NAMES];
+uint16_t Telemetry::name_count = 0;
+uint8_t Telemetry::sequence = 0;
+uint32_t Telemetry::dropped = 0;
+
+/// @brief CRC-16/CCITT-FALSE, polynomial 0x1021 and initial value 0xFFFF.
+static uint16_t crc16(const uint8_t *data, size_t length)
+{
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+/// @brief Consistent Overhead Byte Stuffing, the output contains no zero bytes.
+/// @return the number of bytes written to output.
+static size_t cobsEncode(const uint8_t *input, size_t length, uint8_t *output)
+{
+    size_t code_index = 0;
+    size_t out = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (input[i] != 0)
+        {
+            output[out++] = input[i];
+            code++;
+        }
+        if (input[i] == 0 || code == 0xFF)
+        {
+            output[code_index] = code;
+            code_index = out++;
+            code = 1;
+        }
+    }
+    output[code_index] = code;
+    return out;
+}
+
+static inline size_t putLittleEndian(uint8_t *buffer, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++)
+    {
+        buffer[i] = (uint8_t)(value >> (8 * i));
+    }
+    return bytes;
+}
+
+/// @brief Starts the task writing queued records to the stream. Does nothing if ENABLE_TELEMETRY is false.
+void Telemetry::beginAsync(Stream &stream)
+{
+    if (!ENABLE_TELEMETRY || Telemetry::stream != nullptr)
+    {
+        return;
+    }
+    queue = xQueueCreate(TELEMETRY_QUEUE_LENGTH, sizeof(TelemetryRecord));
+    // recursive, TelemetryStream holds it while sending a line
+    write_sem = xSemaphoreCreateRecursiveMutex();
+    Telemetry::stream = &stream;
+    xTaskCreatePinnedToCore(
+        Telemetry::sendTask,
+        "telemetry",
+        4096, /* Stack size in words */
+        nullptr,
+        1, /* Priority of the task */
+        nullptr,
+        tskNO_AFFINITY);
+}
+
+/// @brief Assigns an id to a histogram or gauge name. Call during setup, the name must live as long as the firmware.
+/// @return the id to record values with, 0 if the table is full or telemetry is disabled.
+uint16_t Telemetry::registerName(TelemetryKind kind, const char *name)
+{
+    if (!ENABLE_TELEMETRY || name_count >= TELEMETRY_MAX_NAMES)
+    {
+        return 0;
+    }
+    names[name_count] = name;
+    kinds[name_count] = kind;
+    // ids start at 1, 0 is never sent
+    uint16_t id = name_count + 1;
+    __atomic_store_n(&name_count, id, __ATOMIC_RELEASE);
+    return id;
+}
+
+void Telemetry::push(const TelemetryRecord &record)
+{
+    if (queue == NULL || record.id == 0)
+    {
+        return;
+    }
+    if (xQueueSend(queue, &record, 0) != pdTRUE)
+    {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/// @brief Adds header and CRC, encodes the frame and writes it with one call.
+void Telemetry::writeFrame(TelemetryFrame type, uint32_t timestamp_us, const uint8_t *payload, size_t length)
+{
+    uint8_t body[TELEMETRY_MAX_BODY];
+    uint8_t frame[TELEMETRY_MAX_FRAME];
+    if (length > TELEMETRY_MAX_TEXT)
+    {
+        length = TELEMETRY_MAX_TEXT;
+    }
+
+    xSemaphoreTakeRecursive(write_sem, portMAX_DELAY);
+    size_t body_length = 0;
+    body[body_length++] = static_cast<uint8_t>(type);
+    body[body_length++] = sequence++;
+    body_length += putLittleEndian(body + body_length, timestamp_us, 4);
+    memcpy(body + body_length, payload, length);
+    body_length += length;
+    body_length += putLittleEndian(body + body_length, crc16(body, body_length), 2);
+
+    size_t frame_length = cobsEncode(body, body_length, frame);
+    frame[frame_length++] = 0;
+    stream->write(frame, frame_length);
+    xSemaphoreGiveRecursive(write_sem);
+}
+
+void Telemetry::writeRecord(const TelemetryRecord &record)
+{
+    uint8_t payload[10];
+    size_t length = putLittleEndian(payload, record.id, 2);
+    if (record.type == TelemetryFrame::Gauge)
+    {
+        uint64_t bits;
+        memcpy(&bits, &record.d, sizeof(bits));
+        length += putLittleEndian(payload + length, bits, 8);
+    }
+    else
+    {
+        length += putLittleEndian(payload + length, (uint64_t)record.i, 8);
+    }
+    writeFrame(record.type, record.timestamp_us, payload, length);
+}
+
+/// @brief Sends all registered names and the number of dropped records.
+void Telemetry::writeNames()
+{
+    uint8_t payload[TELEMETRY_MAX_TEXT];
+    uint16_t count = __atomic_load_n(&name_count, __ATOMIC_ACQUIRE);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        size_t length = putLittleEndian(payload, i + 1, 2);
+        payload[length++] = static_cast<uint8_t>(kinds[i]);
+        size_t name_length = strnlen(names[i], sizeof(payload) - length);
+        memcpy(payload + length, names[i], name_length);
+        writeFrame(TelemetryFrame::Name, (uint32_t)esp_timer_get_time(), payload, length + name_length);
+    }
+    size_t length = putLittleEndian(payload, __atomic_load_n(&dropped, __ATOMIC_RELAXED), 4);
+    writeFrame(TelemetryFrame::Stats, (uint32_t)esp_timer_get_time(), payload, length);
+}
+
+/// @brief Sends a text frame, e.g. a log line. Lines longer than TELEMETRY_MAX_TEXT are split.
+void Telemetry::writeText(const uint8_t *text, size_t length)
+{
+    if (stream == nullptr)
+    {
+        return;
+    }
+    do
+    {
+        size_t part = length < TELEMETRY_MAX_TEXT ? length : TELEMETRY_MAX_TEXT;
+        writeFrame(TelemetryFrame::Text, (uint32_t)esp_timer_get_time(), text, part);
+        text += part;
+        length -= part;
+    } while (length > 0);
+}
+
+void Telemetry::sendTask(void *args)
+{
+    TelemetryRecord record;
+    int64_t last_names_us = -(int64_t)TELEMETRY_NAMES_INTERVAL_MS * 1000;
+    while (true)
+    {
+        if (esp_timer_get_time() - last_names_us >= (int64_t)TELEMETRY_NAMES_INTERVAL_MS * 1000)
+        {
+            writeNames();
+            last_names_us = esp_timer_get_time();
+        }
+        if (xQueueReceive(queue, &record, TELEMETRY_NAMES_INTERVAL_MS / portTICK_PERIOD_MS) == pdTRUE)
+        {
+            writeRecord(record);
+        }
+    }
+}
+
+size_t TelemetryStream::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+/// @brief Buffers up to the end of the line and sends it as one text frame. Carriage returns are dropped.
+size_t TelemetryStream::write(const uint8_t *buffer, size_t size)
+{
+    if (Telemetry::stream == nullptr)
+    {
+        return size;
+    }
+    xSemaphoreTakeRecursive(Telemetry::write_sem, portMAX_DELAY);
+    for (size_t i = 0; i < size; i++)
+    {
+        if (buffer[i] == '\n' || length == sizeof(line))
+        {
+            Telemetry::writeText(line, length);
+            length = 0;
+        }
+        if (buffer[i] != '\n' && buffer[i] != '\r')
+        {
+            line[length++] = buffer[i];
+        }
+    }
+    xSemaphoreGiveRecursive(Telemetry::write_sem);
+    return size;
+}
@@ -0,0 +1,77 @@
+#include "trace.h"
+
+TraceRecord Trace::buffer[TRACE_BUFFER_RECORDS];
+uint32_t Trace::next_index = 0;
+
+static void printHex(Stream &stream, const uint8_t *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    char line[2 * sizeof(TraceRecord) + 1];
+    for (size_t i = 0; i < len; i++)
+    {
+        line[2 * i] = digits[data[i] >> 4];
+        line[2 * i + 1] = digits[data[i] & 0x0f];
+    }
+    line[2 * len] = '\0';
+    stream.println(line);
+}
+
+/// @brief Measures the cost of one record call. The calls write to a scratch record with its own index, so the
+/// buffer is left untouched.
+uint32_t Trace::measureRecordNanos()
+{
+    static TraceRecord scratch[2];
+    static uint32_t scratch_index = 0;
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < TRACE_COST_MEASURE_RECORDS; i++)
+    {
+        uint32_t index = __atomic_fetch_add(&scratch_index, 1, __ATOMIC_RELAXED) % 2;
+        fill(scratch[index], TraceEvent::Value, (uint16_t)i);
+    }
+    return (uint32_t)((esp_timer_get_time() - start) * 1000 / TRACE_COST_MEASURE_RECORDS);
+}
+
+/// @brief Writes the trace buffer, oldest record first, followed by the names of all recorded tasks
+/// and the share of one core spent recording at the rate of the dumped records.
+/// Records written while dumping may be overwritten and show up out of order.
+void Trace::dump(Stream &stream)
+{
+    uint32_t end = __atomic_load_n(&next_index, __ATOMIC_RELAXED);
+    uint32_t count = end < TRACE_BUFFER_RECORDS ? end : TRACE_BUFFER_RECORDS;
+    uint32_t start = end - count;
+
+    stream.printf("TRACE_BEGIN %u %u\n", count, end - count);
+    uint32_t tasks[8];
+    size_t task_count = 0;
+    for (uint32_t i = start; i < end; i++)
+    {
+        const TraceRecord &record = buffer[i % TRACE_BUFFER_RECORDS];
+        stream.print("TR ");
+        printHex(stream, reinterpret_cast<const uint8_t *>(&record), sizeof(TraceRecord));
+
+        bool known = false;
+        for (size_t t = 0; t < task_count; t++)
+        {
+            known |= tasks[t] == record.task;
+        }
+        if (!known && task_count < 8)
+        {
+            tasks[task_count++] = record.task;
+        }
+    }
+    // All traced tasks run for the lifetime of the firmware, so their handles are still valid here
+    for (size_t t = 0; t < task_count; t++)
+    {
+        stream.printf("TRACE_TASK %08x %s\n", tasks[t], pcTaskGetName((TaskHandle_t)(uintptr_t)tasks[t]));
+    }
+    if (count >= 2)
+    {
+        uint32_t span_us = buffer[(end - 1) % TRACE_BUFFER_RECORDS].timestamp_us - buffer[start % TRACE_BUFFER_RECORDS].timestamp_us;
+        uint32_t record_ns = measureRecordNanos();
+        uint64_t records_per_s = span_us > 0 ? (uint64_t)(count - 1) * 1000000 / span_us : 0;
+        // hundredths of a percent of one core
+        uint32_t cost = (uint32_t)(records_per_s * record_ns / 100000);
+        stream.printf("TRACE_COST %u ns/record %u records/s %u.%02u%%\n", record_ns, (uint32_t)records_per_s, cost / 100, cost % 100);
+    }
+    stream.println("TRACE_END");
+}
@@ -1,12 +1,11 @@
 #include "transport.h"
 
 Transport::Transport(const int wifi_status_pin, const char *wifi_ssid, const char *wifi_password)
-    : wifiStatusPin(wifi_status_pin), wifiSSID(wifi_ssid), wifiPassword(wifi_password)
+    : wifiSSID(wifi_ssid), wifiPassword(wifi_password), wifi(wifi_ssid, wifi_password), wifiStatusPin(wifi_status_pin)
 {
     promTransport = PromLokiTransport();
-    promClient = PromClient(promTransport);
-    promTransport.setUseTls(true);
-    promTransport.setCerts(grafanaCert, strlen(grafanaCert));
+    // only used for Wi-Fi and time, the Remote Write endpoints bring their own TLS clients
+    promTransport.setUseTls(false);
     promTransport.setWifiSsid(wifiSSID);
     promTransport.setWifiPass(wifiPassword);
     semaphore = xSemaphoreCreateBinary();
@@ -24,38 +23,44 @@ Transport::~Transport()
         vTaskDelete(blinkTaskHandle);
         blinkTaskHandle = NULL;
     }
-    delete &promClient;
     delete &promTransport;
     vSemaphoreDelete(semaphore);
     digitalWrite(wifiStatusPin, LOW);
 }
 
+/// @brief Must be called before beginAsync.
 void Transport::setDebug(Stream &stream)
 {
-    promTransport.setDebug(stream);
-    promClient.setDebug(stream);
-    debug = &stream;
+    debugStream.setStream(&stream);
+    promTransport.setDebug(debugStream);
 }
 
-void Transport::setEndpoint(uint16_t port, const char *host, char *path)
+/// @brief Drops the output to the debug stream set with setDebug() while muted, e.g. under memory pressure.
+/// Does not wait for the transport, a running connect or reconnect is muted from its next write on.
+void Transport::setDebugMuted(bool muted)
 {
-    promClient.setPort(port);
-    promClient.setUrl(host);
-    promClient.setPath(path);
+    debugStream.setMuted(muted);
 }
 
-void Transport::setCredentials(const char *user, const char *pass)
+void Transport::setConnectDurationHistogram(Prometheus_Histogram *connect_duration)
 {
-    promClient.setUser(user);
-    promClient.setPass(pass);
+    wifi.setConnectDurationHistogram(connect_duration);
+}
+
+int32_t Transport::getWifiFastConnectFailures()
+{
+    return wifi.getFastConnectFailures();
 }
 
 bool Transport::isInitialized()
 {
     bool result = false;
+    Trace::record(TraceEvent::SemWait, TRACE_SEM_TRANSPORT);
     if (xSemaphoreTake(semaphore, (TickType_t)10) == pdTRUE)
     {
+        Trace::record(TraceEvent::SemAcquired, TRACE_SEM_TRANSPORT);
         result = transportInitialized;
+        Trace::record(TraceEvent::SemReleased, TRACE_SEM_TRANSPORT);
         xSemaphoreGive(semaphore);
     }
     return result;
@@ -66,35 +71,27 @@ int64_t Transport::getTimeMillis()
     int64_t result = -1;
     while (result < 0)
     {
+        Trace::record(TraceEvent::SemWait, TRACE_SEM_TRANSPORT);
         if (xSemaphoreTake(semaphore, (TickType_t)50) == pdTRUE)
         {
+            Trace::record(TraceEvent::SemAcquired, TRACE_SEM_TRANSPORT);
             if (transportInitialized)
             {
                 result = promTransport.getTimeMillis();
             }
+            Trace::record(TraceEvent::SemReleased, TRACE_SEM_TRANSPORT);
             xSemaphoreGive(semaphore);
         }
     }
-    if (debug != nullptr)
-    {
-        debug->printf("getTimeMillis: %jd\n", result);
-    }
+    LOG_DEBUG("getTimeMillis: %d", result);
     return result;
 }
 
-PromClient::SendResult Transport::send(WriteRequest &req)
-{
-    PromClient::SendResult res = promClient.send(req);
-    if (!res == PromClient::SendResult::SUCCESS)
-    {
-        Serial.println(promClient.errmsg);
-    }
-    return res;
-}
-
 void Transport::beginAsync()
 {
     digitalWrite(wifiStatusPin, LOW);
+    // register for events before the task connects
+    wifi.begin();
     xTaskCreatePinnedToCore(
         Transport::connectTask,
         "transport connect",
@@ -108,30 +105,34 @@ void Transport::beginAsync()
 void Transport::connectTask(void *args)
 {
     Transport *instance = static_cast<Transport *>(args);
+    // connectTaskHandle may not be assigned yet, the task can run before xTaskCreatePinnedToCore returns
+    instance->wifi.setNotifyTask(xTaskGetCurrentTaskHandle());
+    uint32_t retry_ms = WIFI_RECONNECT_RETRY_MS;
 
     while (true)
     {
         // ensure init
+        Trace::record(TraceEvent::SemWait, TRACE_SEM_TRANSPORT);
         if (xSemaphoreTake(instance->semaphore, (TickType_t)1000) == pdTRUE)
         {
+            Trace::record(TraceEvent::SemAcquired, TRACE_SEM_TRANSPORT);
             try
             {
                 if (!instance->transportInitialized)
                 {
+                    Trace::record(TraceEvent::TaskBegin, TRACE_SPAN_TRANSPORT_CONNECT);
                     instance->startLedBlink(StatusIndicator::Connecting);
                     if (!instance->promTransport.begin())
                     {
-                        Serial.println(instance->promTransport.errmsg);
-                    }
-                    else if (!instance->promClient.begin())
-                    {
-                        Serial.println(instance->promClient.errmsg);
+                        LOG_ERROR("%s", instance->promTransport.errmsg);
                     }
                     else
                     {
                         instance->transportInitialized = true;
                     }
+                    Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_TRANSPORT_CONNECT);
 
+                    Trace::record(TraceEvent::SemReleased, TRACE_SEM_TRANSPORT);
                     xSemaphoreGive(instance->semaphore);
                     vTaskDelay(5000 / portTICK_PERIOD_MS);
                     continue;
@@ -139,11 +140,14 @@ void Transport::connectTask(void *args)
             }
             catch (const std::exception &e)
             {
-                Serial.println(e.what());
+                instance->logException(e);
+                Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_TRANSPORT_CONNECT);
+                Trace::record(TraceEvent::SemReleased, TRACE_SEM_TRANSPORT);
                 xSemaphoreGive(instance->semaphore);
                 vTaskDelay(5000 / portTICK_PERIOD_MS);
                 continue;
             }
+            Trace::record(TraceEvent::SemReleased, TRACE_SEM_TRANSPORT);
             xSemaphoreGive(instance->semaphore);
         }
         else
@@ -153,14 +157,13 @@ void Transport::connectTask(void *args)
         }
 
         // update LED status and try to reconnect if required
+        uint32_t wait_ms = WIFI_STATUS_CHECK_INTERVAL_SECONDS * 1000;
         wl_status_t wifiStatus = WiFi.status();
         if (wifiStatus == WL_CONNECTED)
         {
+            retry_ms = WIFI_RECONNECT_RETRY_MS;
             int8_t dbm = WiFi.RSSI();
-            if (instance->debug != nullptr)
-            {
-                instance->debug->println("Wifi Signal: " + String(dbm) + "dBm");
-            }
+            LOG_DEBUG("Wifi Signal: %ddBm", dbm);
             if (dbm > -70)
             {
                 // good/fair connection
@@ -172,26 +175,58 @@ void Transport::connectTask(void *args)
                 // bad connection
                 instance->startLedBlink(StatusIndicator::ConnectedBadSignal);
             }
+            instance->wifi.renewExpiredLease();
         }
         else
         {
             instance->startLedBlink(StatusIndicator::Connecting);
+            bool reconnected = false;
             try
             {
-                instance->promTransport.checkAndReconnectConnection();
+                Trace::record(TraceEvent::TaskBegin, TRACE_SPAN_TRANSPORT_CONNECT);
+                reconnected = instance->wifi.reconnect();
+                Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_TRANSPORT_CONNECT);
             }
             catch (const std::exception &e)
             {
-                Serial.println(e.what());
+                instance->logException(e);
+                Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_TRANSPORT_CONNECT);
+            }
+            if (reconnected)
+            {
+                retry_ms = WIFI_RECONNECT_RETRY_MS;
+            }
+            else
+            {
+                // The disconnect events of the attempt were suppressed, so none may wake the task up again.
+                // Retry with a backoff instead of waiting for the status check.
+                LOG_DEBUG("Wifi reconnect failed, retrying in %u ms", retry_ms);
+                wait_ms = retry_ms;
+                if (retry_ms < WIFI_STATUS_CHECK_INTERVAL_SECONDS * 1000 / 2)
+                {
+                    retry_ms *= 2;
+                }
             }
         }
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
+        // wait for a connect or disconnect event, or refresh the signal LED or retry the reconnect after wait_ms
+        ulTaskNotifyTake(pdTRUE, wait_ms / portTICK_PERIOD_MS);
     }
 }
 
+/// @brief Logs the message of an exception caught by the connect task.
+/// The message does not outlive the exception, so it is copied to a buffer that is only overwritten by the next
+/// exception, at least one reconnect attempt later.
+void Transport::logException(const std::exception &e)
+{
+    strncpy(exceptionMessage, e.what(), sizeof(exceptionMessage) - 1);
+    exceptionMessage[sizeof(exceptionMessage) - 1] = '\0';
+    LOG_ERROR("%s", exceptionMessage);
+}
+
 void Transport::startLedBlink(StatusIndicator statusIndicator)
 {
-    blinkIntervalMs = static_cast<int>(statusIndicator);
+    // read by the blink task without the semaphore
+    __atomic_store_n(&blinkIntervalMs, static_cast<int>(statusIndicator), __ATOMIC_RELAXED);
     if (blinkTaskHandle != NULL)
     {
         // blink task already running
@@ -222,8 +257,8 @@ void Transport::blinkLedTask(void *args)
     while (true)
     {
         digitalWrite(instance->wifiStatusPin, HIGH);
-        vTaskDelay(instance->blinkIntervalMs / portTICK_PERIOD_MS);
+        vTaskDelay(__atomic_load_n(&instance->blinkIntervalMs, __ATOMIC_RELAXED) / portTICK_PERIOD_MS);
         digitalWrite(instance->wifiStatusPin, LOW);
-        vTaskDelay(instance->blinkIntervalMs / portTICK_PERIOD_MS);
+        vTaskDelay(__atomic_load_n(&instance->blinkIntervalMs, __ATOMIC_RELAXED) / portTICK_PERIOD_MS);
     }
 }
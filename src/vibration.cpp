@@ -1,10 +1,10 @@
 #include "vibration.h"
 
-Vibration::Vibration(hw_timer_t *timer, int32_t vibration_detection_threshold_ms, Prometheus_Histogram *coffees_consumed)
+Vibration::Vibration(int32_t vibration_detection_threshold_ms, Prometheus_Histogram *coffees_consumed, Prometheus_Summary *brew_duration)
+    : detector(vibration_detection_threshold_ms)
 {
-    Vibration::timer = timer;
-    Vibration::vibration_detection_threshold_ms = vibration_detection_threshold_ms;
     Vibration::coffees_consumed = coffees_consumed;
+    Vibration::brew_duration = brew_duration;
 }
 
 Vibration::~Vibration()
@@ -12,14 +12,14 @@ Vibration::~Vibration()
     if (vibration_detection_task != NULL){
         vTaskDelete(vibration_detection_task);
     }
-    timerStop(timer);
+    digitalWrite(VIBRATION_DETECTION_LED_VCC, LOW);
 }
 
 void Vibration::beginAsync()
 {
     if (vibration_detection_task == NULL)
     {
-        Serial.println("Starting vibration detection");
+        LOG_INFO("Starting vibration detection");
         xTaskCreatePinnedToCore(
             Vibration::vibration_dection_task,
             "vibration detection",
@@ -36,41 +36,51 @@ void Vibration::vibration_dection_task(void *args)
     Vibration *instance = static_cast<Vibration *>(args);
     while (true)
     {
-        int64_t duration_ms = detect_vibration(instance->timer);
-        if (duration_ms >= instance->vibration_detection_threshold_ms)
-        {
-            if (DEBUG)
-            {
-                Serial.println("Vibration detected (" + String(duration_ms) + " ms)");
-            }
-            instance->coffees_consumed->AddValue(duration_ms);
-        }
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        Trace::record(TraceEvent::TaskBegin, TRACE_SPAN_VIBRATION_DETECT);
+        instance->poll_vibration();
+        Trace::record(TraceEvent::TaskEnd, TRACE_SPAN_VIBRATION_DETECT);
+        vTaskDelay(VIBRATION_POLL_INTERVAL_MS / portTICK_PERIOD_MS);
     }
 }
 
-/// @brief Reads the vibration sensor an returns the duration of the detected vibration.
-/// @return Duration of detected vibration.
-int64_t Vibration::detect_vibration(hw_timer_t *timer)
+/// @brief Reads the vibration sensor once and adds the duration of a finished vibration to the histogram
+/// if it reached the detection threshold.
+void Vibration::poll_vibration()
 {
-    timerWrite(timer, 0);
+    bool vibrating = digitalRead(VIBRATION_SENSOR_PIN) == LOW;
+    int64_t now_ms = esp_timer_get_time() / 1000;
 
-    while (digitalRead(VIBRATION_SENSOR_PIN) == LOW)
+    if (vibrating != detector.isVibrating())
     {
-        timerStart(timer);
-        digitalWrite(VIBRATION_DETECTION_LED_VCC, HIGH);
-        vTaskDelay(50 / portTICK_PERIOD_MS);
+        Trace::record(TraceEvent::GpioEdge, VIBRATION_SENSOR_PIN << 1 | (vibrating ? LOW : HIGH));
+        Telemetry::event(TELEMETRY_EVENT_VIBRATION_EDGE, vibrating ? 1 : 0);
+        digitalWrite(VIBRATION_DETECTION_LED_VCC, vibrating ? HIGH : LOW);
+        if (ENABLE_VIBRATION_RECORDING)
+        {
+            // Edge timeline for tools/vibration_replay, logged so it ends up in a text frame if telemetry is on
+            LOG_INFO("VR %lld %d", now_ms, vibrating ? 1 : 0);
+        }
     }
 
-    timerStop(timer);
-    digitalWrite(VIBRATION_DETECTION_LED_VCC, LOW);
-
-    int64_t vibration_duration_ms = timerReadMilis(timer);
-
-    if (DEBUG && vibration_duration_ms > 1000)
+    VibrationEvent event;
+    if (!detector.update(now_ms, vibrating, event))
     {
-        Serial.println("Vibration " + String(vibration_duration_ms));
+        return;
     }
 
-    return vibration_duration_ms;
-}
\ No newline at end of file
+    if (event.duration_ms > 1000)
+    {
+        LOG_DEBUG("Vibration %d", event.duration_ms);
+    }
+    if (event.counted)
+    {
+        LOG_DEBUG("Vibration detected (%d ms)", event.duration_ms);
+        Trace::record(TraceEvent::Value, event.duration_ms > UINT16_MAX ? UINT16_MAX : event.duration_ms);
+        Telemetry::event(TELEMETRY_EVENT_COFFEE, event.duration_ms);
+        coffees_consumed->AddValue(event.duration_ms);
+        if (brew_duration != nullptr)
+        {
+            brew_duration->AddValue(event.duration_ms);
+        }
+    }
+}
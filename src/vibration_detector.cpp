@@ -0,0 +1,34 @@
+#include "vibration_detector.h"
+
+VibrationDetector::VibrationDetector(int32_t vibration_detection_threshold_ms)
+    : vibration_detection_threshold_ms(vibration_detection_threshold_ms)
+{
+}
+
+/// @brief Feeds one poll of the vibration sensor.
+/// @param now_ms Time of the poll in milliseconds.
+/// @param vibrating Whether the sensor reported vibration.
+/// @param event Set to the finished vibration if true is returned.
+/// @return true if a vibration ended with this poll.
+bool VibrationDetector::update(int64_t now_ms, bool vibrating, VibrationEvent &event)
+{
+    if (vibrating == this->vibrating)
+    {
+        return false;
+    }
+    this->vibrating = vibrating;
+    if (vibrating)
+    {
+        vibration_start_ms = now_ms;
+        return false;
+    }
+    event.start_ms = vibration_start_ms;
+    event.duration_ms = now_ms - vibration_start_ms;
+    event.counted = event.duration_ms >= vibration_detection_threshold_ms;
+    return true;
+}
+
+bool VibrationDetector::isVibrating()
+{
+    return vibrating;
+}
@@ -0,0 +1,183 @@
+#include "wifi_connection.h"
+
+#define WIFI_CONNECTION_CACHE_MAGIC 0xC0FFEE01
+
+RTC_DATA_ATTR static WifiConnectionCache cache;
+
+WifiConnection::WifiConnection(const char *wifi_ssid, const char *wifi_password)
+    : wifiSSID(wifi_ssid), wifiPassword(wifi_password)
+{
+}
+
+/// @brief Registers for Wi-Fi events. Must be called before anything connects, so no GOT_IP event is missed.
+void WifiConnection::begin()
+{
+    // reconnects are handled by reconnect(), the built-in one always does a full scan
+    WiFi.setAutoReconnect(false);
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info)
+                 { onWifiEvent(event); });
+}
+
+/// @brief The task is notified on every connect and disconnect, except the ones caused by reconnect() itself.
+void WifiConnection::setNotifyTask(TaskHandle_t notify_task)
+{
+    __atomic_store_n(&notifyTask, notify_task, __ATOMIC_RELEASE);
+}
+
+void WifiConnection::onWifiEvent(arduino_event_id_t event)
+{
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+    {
+        connected = true;
+        storeCache();
+    }
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED)
+    {
+        connected = false;
+        // Events are delivered in order, so the one of the disconnect at the start of connect() arrives
+        // before the connect completes. The connecting task does not need to be woken up for it.
+        if (__atomic_load_n(&connecting, __ATOMIC_ACQUIRE))
+        {
+            return;
+        }
+        Telemetry::event(TELEMETRY_EVENT_WIFI_DISCONNECTED);
+    }
+    else
+    {
+        return;
+    }
+    TaskHandle_t task = __atomic_load_n(&notifyTask, __ATOMIC_ACQUIRE);
+    if (task != NULL)
+    {
+        xTaskNotifyGive(task);
+    }
+}
+
+void WifiConnection::storeCache()
+{
+    uint8_t *bssid = WiFi.BSSID();
+    if (bssid == nullptr)
+    {
+        return;
+    }
+    memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+    cache.channel = WiFi.channel();
+    cache.ip = WiFi.localIP();
+    cache.gateway = WiFi.gatewayIP();
+    cache.subnet = WiFi.subnetMask();
+    cache.dns = WiFi.dnsIP();
+    if (!usingCachedLease)
+    {
+        // A static IP does not renew the lease, so only a DHCP handout restarts its age. The system time is not
+        // synced by NTP yet at this point, the RTC time is valid from boot.
+        cache.lease_start_us = esp_rtc_get_time_us();
+    }
+    cache.magic = WIFI_CONNECTION_CACHE_MAGIC;
+}
+
+/// @brief The lease may be reused until WIFI_FAST_CONNECT_LEASE_SECONDS after its handout. An RTC time before the
+/// handout, e.g. after a power loss reset the RTC, counts as expired.
+bool WifiConnection::isLeaseValid()
+{
+    int64_t now_us = esp_rtc_get_time_us();
+    return now_us >= cache.lease_start_us && now_us - cache.lease_start_us < WIFI_FAST_CONNECT_LEASE_SECONDS * 1000000LL;
+}
+
+/// @brief Reconnects with DHCP if the current connection still uses a reused lease that expired.
+/// Called periodically while connected, the DHCP server may hand out an expired address again.
+void WifiConnection::renewExpiredLease()
+{
+    if (!__atomic_load_n(&usingCachedLease, __ATOMIC_RELAXED) || isLeaseValid())
+    {
+        return;
+    }
+    LOG_INFO("Reused IP lease expired, reconnecting with DHCP");
+    reconnect();
+}
+
+bool WifiConnection::isConnected()
+{
+    return connected;
+}
+
+void WifiConnection::setConnectDurationHistogram(Prometheus_Histogram *connect_duration)
+{
+    connectDuration = connect_duration;
+}
+
+int32_t WifiConnection::getFastConnectFailures()
+{
+    return fastConnectFailures;
+}
+
+/// @brief Reconnects using the cached access point and, while valid, its lease first, then with a full scan and DHCP.
+/// @return true if connected.
+bool WifiConnection::reconnect()
+{
+    int64_t start_ms = esp_timer_get_time() / 1000;
+    bool success = false;
+    if (cache.magic == WIFI_CONNECTION_CACHE_MAGIC)
+    {
+        success = connect(true);
+        if (!success)
+        {
+            fastConnectFailures++;
+            // The access point or lease may have changed, don't try it again
+            cache.magic = 0;
+        }
+    }
+    if (!success)
+    {
+        success = connect(false);
+    }
+    if (success)
+    {
+        int64_t duration_ms = esp_timer_get_time() / 1000 - start_ms;
+        Telemetry::event(TELEMETRY_EVENT_WIFI_CONNECTED, duration_ms);
+        if (connectDuration != nullptr)
+        {
+            connectDuration->AddValue(duration_ms);
+        }
+    }
+    return success;
+}
+
+bool WifiConnection::connect(bool fast)
+{
+    __atomic_store_n(&connecting, true, __ATOMIC_RELEASE);
+    WiFi.disconnect();
+    bool static_ip = fast && WIFI_FAST_CONNECT_STATIC_IP && isLeaseValid();
+    __atomic_store_n(&usingCachedLease, static_ip, __ATOMIC_RELAXED);
+    if (static_ip)
+    {
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    }
+    else
+    {
+        // back to DHCP
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    }
+    if (fast)
+    {
+        WiFi.begin(wifiSSID, wifiPassword, cache.channel, cache.bssid);
+    }
+    else
+    {
+        WiFi.begin(wifiSSID, wifiPassword);
+    }
+
+    int64_t deadline_ms = esp_timer_get_time() / 1000 + (fast ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS);
+    while (WiFi.status() != WL_CONNECTED)
+    {
+        if (esp_timer_get_time() / 1000 > deadline_ms)
+        {
+            __atomic_store_n(&connecting, false, __ATOMIC_RELEASE);
+            LOG_DEBUG("%s Wifi connect timed out", fast ? "Fast" : "Full");
+            return false;
+        }
+        vTaskDelay(20 / portTICK_PERIOD_MS);
+    }
+    __atomic_store_n(&connecting, false, __ATOMIC_RELEASE);
+    LOG_DEBUG("%s Wifi connect successful", fast ? "Fast" : "Full");
+    return true;
+}
@@ -0,0 +1,84 @@
+// Minimal snappy block-format compressor shared by the host tools.
+//
+// Output decompresses with any snappy implementation, but is not byte-identical with the output of
+// SnappyProto on the device: matches are found with a single hash table probe and are at most 64 bytes.
+
+#ifndef TOOLS_SNAPPY_BLOCK_INCLUDED
+#define TOOLS_SNAPPY_BLOCK_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static void snappyPutVarint(std::string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((char)value);
+}
+
+static void snappyEmitLiteral(std::string &out, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t chunk = len < 65536 ? len : 65536;
+        if (chunk <= 60)
+        {
+            out.push_back((char)((chunk - 1) << 2));
+        }
+        else if (chunk <= 256)
+        {
+            out.push_back((char)(60 << 2));
+            out.push_back((char)(chunk - 1));
+        }
+        else
+        {
+            out.push_back((char)(61 << 2));
+            out.push_back((char)((chunk - 1) & 0xff));
+            out.push_back((char)((chunk - 1) >> 8));
+        }
+        out.append(data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static std::string snappyCompress(const std::string &in)
+{
+    std::string out;
+    snappyPutVarint(out, in.size());
+    std::vector<int64_t> table(1 << 14, -1);
+    size_t literal_start = 0;
+    size_t i = 0;
+    while (i + 4 <= in.size())
+    {
+        uint32_t word;
+        memcpy(&word, in.data() + i, 4);
+        uint32_t hash = (word * 0x1e35a7bd) >> 18;
+        int64_t candidate = table[hash];
+        table[hash] = i;
+        if (candidate < 0 || i - candidate > 65535 || memcmp(in.data() + candidate, in.data() + i, 4) != 0)
+        {
+            i++;
+            continue;
+        }
+        snappyEmitLiteral(out, in.data() + literal_start, i - literal_start);
+        size_t length = 4;
+        while (i + length < in.size() && length < 64 && in[candidate + length] == in[i + length])
+            length++;
+        size_t offset = i - candidate;
+        out.push_back((char)(((length - 1) << 2) | 2));
+        out.push_back((char)(offset & 0xff));
+        out.push_back((char)(offset >> 8));
+        i += length;
+        literal_start = i;
+    }
+    snappyEmitLiteral(out, in.data() + literal_start, in.size() - literal_start);
+    return out;
+}
+
+#endif
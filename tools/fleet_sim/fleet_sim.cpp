@@ -0,0 +1,485 @@
+// Simulates a fleet of coffee counters pushing to a Remote Write endpoint, e.g. tools/remote_write_receiver.py.
+//
+// Build and run from the repository root:
+//   g++ -std=gnu++17 -O2 -Itools/freertos_posix/include -Iinclude tools/fleet_sim/fleet_sim.cpp tools/freertos_posix/freertos_posix.cpp tools/freertos_posix/wifi.cpp tools/freertos_posix/wifi_client.cpp tools/freertos_posix/http_client.cpp src/vibration_detector.cpp src/prometheus_histogram.cpp src/prometheus_summary.cpp src/quantile_sketch.cpp src/metric_series.cpp src/metric_registry.cpp src/remote_write_encoder.cpp src/remote_write_v1.cpp src/remote_write_v2.cpp src/remote_write_payload.cpp src/remote_write_fanout.cpp src/remote_write_endpoint.cpp src/log.cpp src/trace.cpp src/telemetry.cpp -o fleet_sim
+//   python3 tools/remote_write_receiver.py --port 8080 &
+//   ./fleet_sim --devices 48 --duration 7200 --outage-at 3600 --outage-for 600
+//
+// Every device runs the firmware's own metric and Remote Write classes on the virtual clock of
+// tools/freertos_posix: VibrationDetector feeds the CMI_coffees_consumed histogram and the brew duration summary
+// of main.cpp, a MetricRegistry ingests them with the system gauges, and a RemoteWriteFanout pushes to a
+// RemoteWriteEndpoint whose send task queues, retries and falls back from 2.0 to 1.0 like on the device, over
+// real HTTP. The main thread runs loop() of main.cpp for every device and polls the sensor every
+// VIBRATION_POLL_INTERVAL_MS; every device has its own WiFi, so reconnects after an outage spread out.
+//
+// Sensor traces are synthetic brews and knocks, or recorded "VR" traces (see tools/vibration_replay)
+// replayed in a loop with a random offset per device. Failure injection:
+//   --outage-at S --outage-for S   all devices lose Wi-Fi, or the endpoint is unreachable with --outage server
+//   --loss P                       every connect fails with probability P
+// --remote-write-version selects the protocol of the endpoints, 1 by default like GC_REMOTE_WRITE_VERSION.
+// --speed sets simulated seconds per wall clock second, 0 runs as fast as the receiver answers.
+// --log prints the firmware log of all devices.
+// Posting takes no virtual time. Each request carries the virtual send time in X-Sim-Time-Ms, which the
+// receiver uses to measure sample delay and how synchronized the fleet pushes.
+
+#include <Arduino.h>
+#include <ArduinoHttpClient.h>
+#include <PromLokiTransport.h>
+#include <WiFi.h>
+#include "config.h"
+#include "log.h"
+#include "metric_registry.h"
+#include "prometheus_histogram.h"
+#include "prometheus_summary.h"
+#include "remote_write_endpoint.h"
+#include "remote_write_fanout.h"
+#include "vibration_detector.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// loop() in main.cpp waits this long after every iteration
+static const int64_t LOOP_INTERVAL_MS = 4000;
+static const double brew_duration_quantiles[] = {0.5, 0.9, 0.99};
+
+struct Options
+{
+    int devices = 24;
+    int first_device = 0;
+    int64_t duration_ms = 3600 * 1000LL;
+    double speed = 60;
+    const char *host = "127.0.0.1";
+    int port = 8080;
+    const char *path = "/api/v1/push";
+    uint8_t remote_write_version = GC_REMOTE_WRITE_VERSION;
+    double brews_per_hour = 6;
+    double knocks_per_hour = 4;
+    std::vector<const char *> traces;
+    int64_t outage_at_ms = -1;
+    int64_t outage_for_ms = 0;
+    bool server_outage = false;
+    double loss = 0;
+    unsigned seed = 1;
+    bool log = false;
+};
+
+struct Edge
+{
+    int64_t time_ms;
+    bool vibrating;
+};
+
+static std::vector<Edge> readTrace(const char *path)
+{
+    std::vector<Edge> edges;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, 3, "VR ") != 0)
+        {
+            continue;
+        }
+        std::istringstream fields(line.substr(3));
+        long long time_ms;
+        int level;
+        if (fields >> time_ms >> level)
+        {
+            edges.push_back({time_ms, level != 0});
+        }
+    }
+    return edges;
+}
+
+class Device
+{
+public:
+    Device(int index, const Options &options, const std::vector<std::vector<Edge>> &traces, std::mt19937 &rng);
+    void step(int64_t now_ms);
+    void wifiLost();
+    void wifiRestored();
+    int64_t getCoffees() { return coffees; }
+    int64_t getPushes() { return pushes; }
+    int32_t getFailures() { return remote_write_failures + fanout->getFailures(); }
+
+private:
+    // device whose gauges are collected, the collectors are plain function pointers
+    static Device *collecting;
+
+    WiFiClass wifi;
+    std::mt19937 &rng;
+    std::string labels;
+    VibrationDetector detector;
+    Prometheus_Histogram *coffees_consumed;
+    Prometheus_Summary *brew_duration;
+    MetricRegistry *metrics;
+    RemoteWriteFanout *fanout;
+    int64_t coffees = 0;
+    int64_t pushes = 0;
+    int32_t remote_write_failures = 0;
+    int64_t boot_ms;
+    int64_t next_loop_ms;
+    int64_t next_sample_ms;
+    int64_t last_ingest_ms;
+    int64_t last_push_ms;
+
+    const std::vector<Edge> *trace = nullptr;
+    int64_t trace_length_ms = 0;
+    int64_t trace_offset_ms = 0;
+    double brew_rate_per_ms = 0;
+    double knock_rate_per_ms = 0;
+    int64_t vibration_start_ms = 0;
+    int64_t vibration_end_ms = 0;
+
+    void scheduleVibration(int64_t after_ms);
+    bool sensorLevel(int64_t now_ms);
+    static double collectFreeHeap();
+    static double collectRssi();
+    static double collectRunTime();
+    static double collectFailures();
+    static double collectTemperature();
+};
+
+Device *Device::collecting = nullptr;
+
+Device::Device(int index, const Options &options, const std::vector<std::vector<Edge>> &traces, std::mt19937 &rng)
+    : rng(rng), detector(MOTION_DETECTION_DURATION_THREASHOLD_SECONDS * 1000)
+{
+    char instance[32];
+    snprintf(instance, sizeof(instance), "%012X", 0xA1B2C3D4 + index);
+    std::string common = "job=\"cmi_coffee_counter\",instance=\"" + std::string(instance) + "\",site=\"sim\",floor=\"" + std::to_string(index % 4) + "\"";
+    labels = "{" + common + "}";
+
+    // the metrics of setup() in main.cpp, without the ones of the device hardware
+    coffees_consumed = new Prometheus_Histogram("CMI_coffees_consumed", labels.c_str(), TIME_SERIES_SAMPLE_COUNT, 12000, 4000, 10);
+    brew_duration = new Prometheus_Summary("CMI_coffee_brew_duration_ms", labels.c_str(), TIME_SERIES_SAMPLE_COUNT, brew_duration_quantiles, 3,
+                                           BREW_DURATION_WINDOW_SECONDS, BREW_DURATION_WINDOW_SLICES, BREW_DURATION_COMPRESSION);
+    metrics = new MetricRegistry(labels.c_str(), TIME_SERIES_SAMPLE_COUNT, METRIC_REGISTRY_CAPACITY);
+    metrics->addAggregatedGauge("ESP32_system_memory_free_bytes", collectFreeHeap);
+    metrics->addAggregatedGauge("ESP32_system_network_wifi_rssi", collectRssi);
+    metrics->addGauge("ESP32_system_run_time_ms", collectRunTime);
+    metrics->addGauge("ESP32_system_remote_write_failures_count", collectFailures);
+    metrics->addGauge("coffee_counter_temperature", collectTemperature);
+    metrics->addHistogram(coffees_consumed);
+    metrics->addSummary(brew_duration);
+
+    RemoteWriteEndpoint *endpoint = new RemoteWriteEndpoint("sim", options.host, options.port, options.path, nullptr, nullptr, nullptr,
+                                                            options.remote_write_version);
+    std::string endpoint_labels = "{" + common + ",endpoint=\"sim\"}";
+    Prometheus_Histogram *send_duration = new Prometheus_Histogram("ESP32_system_remote_write_send_duration_ms", endpoint_labels.c_str(),
+                                                                   TIME_SERIES_SAMPLE_COUNT, 500, 1000, 4);
+    metrics->addHistogram(send_duration);
+    endpoint->setSendDurationHistogram(send_duration);
+    fanout = new RemoteWriteFanout(*metrics, 1);
+    fanout->addEndpoint(endpoint);
+
+    wifi.simulateRssi((int8_t)std::max(-90.0, std::min(-40.0, std::normal_distribution<double>(-62, 6)(rng))));
+    wifi.simulateConnectDelay(0, 0);
+    wifi.begin(nullptr, nullptr);
+    // the send task inherits the context, so WiFi is this device's connection there
+    FreeRtosPosix::setContext(&wifi);
+    fanout->beginAsync();
+    FreeRtosPosix::setContext(nullptr);
+
+    // Devices are powered on at different times, so their schedules start spread over one push interval
+    boot_ms = std::uniform_int_distribution<int64_t>(0, REMOTE_WRITE_INTERVAL_SECONDS * 1000 - 1)(rng);
+    next_loop_ms = boot_ms;
+    next_sample_ms = boot_ms;
+    last_ingest_ms = boot_ms;
+    last_push_ms = boot_ms;
+
+    if (!traces.empty())
+    {
+        trace = &traces[index % traces.size()];
+        if (!trace->empty())
+        {
+            trace_length_ms = trace->back().time_ms - trace->front().time_ms + 60000;
+            trace_offset_ms = std::uniform_int_distribution<int64_t>(0, trace_length_ms - 1)(rng);
+        }
+    }
+    else
+    {
+        brew_rate_per_ms = options.brews_per_hour / 3600000.0;
+        knock_rate_per_ms = options.knocks_per_hour / 3600000.0;
+        scheduleVibration(0);
+    }
+}
+
+void Device::wifiLost()
+{
+    wifi.simulateDisconnect();
+}
+
+void Device::wifiRestored()
+{
+    // The reconnect is started by the next Wi-Fi event or status check, then takes a fast connect
+    int64_t check_ms = std::uniform_int_distribution<int64_t>(0, WIFI_STATUS_CHECK_INTERVAL_SECONDS * 1000)(rng);
+    int64_t connect_ms = std::uniform_int_distribution<int64_t>(300, 1500)(rng);
+    wifi.simulateConnectDelay(check_ms + connect_ms, check_ms + connect_ms);
+    wifi.begin(nullptr, nullptr);
+}
+
+void Device::scheduleVibration(int64_t after_ms)
+{
+    double rate = brew_rate_per_ms + knock_rate_per_ms;
+    if (rate <= 0)
+    {
+        vibration_start_ms = vibration_end_ms = INT64_MAX;
+        return;
+    }
+    vibration_start_ms = after_ms + (int64_t)std::exponential_distribution<double>(rate)(rng);
+    bool brew = std::uniform_real_distribution<double>(0, rate)(rng) < brew_rate_per_ms;
+    int64_t duration_ms = brew ? std::uniform_int_distribution<int64_t>(15000, 40000)(rng)
+                               : std::uniform_int_distribution<int64_t>(500, 3000)(rng);
+    vibration_end_ms = vibration_start_ms + duration_ms;
+}
+
+bool Device::sensorLevel(int64_t now_ms)
+{
+    if (trace != nullptr)
+    {
+        if (trace->empty())
+            return false;
+        int64_t t = trace->front().time_ms + (now_ms + trace_offset_ms) % trace_length_ms;
+        auto next = std::upper_bound(trace->begin(), trace->end(), t, [](int64_t time_ms, const Edge &edge)
+                                     { return time_ms < edge.time_ms; });
+        return next != trace->begin() && (next - 1)->vibrating;
+    }
+    while (now_ms >= vibration_end_ms)
+    {
+        scheduleVibration(vibration_end_ms);
+    }
+    return now_ms >= vibration_start_ms;
+}
+
+/// @brief One sensor poll of Vibration, and one iteration of loop() in main.cpp when it is due.
+void Device::step(int64_t now_ms)
+{
+    int64_t timestamp = PROM_LOKI_TRANSPORT_EPOCH_MS + now_ms;
+    VibrationEvent event;
+    if (detector.update(timestamp, sensorLevel(now_ms), event) && event.counted)
+    {
+        coffees_consumed->AddValue(event.duration_ms);
+        brew_duration->AddValue(event.duration_ms);
+        coffees++;
+    }
+
+    collecting = this;
+    if (now_ms >= next_sample_ms)
+    {
+        // the sampling task of the registry, run here so the collectors know their device
+        metrics->sample();
+        next_sample_ms = now_ms + GAUGE_SAMPLING_INTERVAL_MS;
+    }
+    if (now_ms >= next_loop_ms)
+    {
+        if (now_ms - last_ingest_ms >= METRICS_INGESTION_RATE_SECONDS * 1000)
+        {
+            metrics->Ingest(timestamp);
+            last_ingest_ms = now_ms;
+        }
+        if (now_ms - last_push_ms >= REMOTE_WRITE_INTERVAL_SECONDS * 1000)
+        {
+            if (fanout->push())
+            {
+                metrics->resetSamples();
+                pushes++;
+                last_push_ms = now_ms;
+            }
+            else
+            {
+                remote_write_failures++;
+            }
+        }
+        next_loop_ms = now_ms + LOOP_INTERVAL_MS;
+    }
+    collecting = nullptr;
+}
+
+double Device::collectFreeHeap()
+{
+    return std::normal_distribution<double>(180000, 4000)(collecting->rng);
+}
+
+double Device::collectRssi()
+{
+    return collecting->wifi.RSSI();
+}
+
+double Device::collectRunTime()
+{
+    return FreeRtosPosix::now() / 1000 - collecting->boot_ms;
+}
+
+double Device::collectFailures()
+{
+    return collecting->getFailures();
+}
+
+double Device::collectTemperature()
+{
+    return std::normal_distribution<double>(24, 0.5)(collecting->rng);
+}
+
+static double percentile(std::vector<double> values, double q)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(q * values.size()))];
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--devices") == 0)
+            options.devices = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--first-device") == 0)
+            options.first_device = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--duration") == 0)
+            options.duration_ms = atoll(argv[++i]) * 1000;
+        else if (i + 1 < argc && strcmp(argv[i], "--speed") == 0)
+            options.speed = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--host") == 0)
+            options.host = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--port") == 0)
+            options.port = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--path") == 0)
+            options.path = argv[++i];
+        else if (i + 1 < argc && strcmp(argv[i], "--remote-write-version") == 0)
+            options.remote_write_version = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--brews-per-hour") == 0)
+            options.brews_per_hour = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--knocks-per-hour") == 0)
+            options.knocks_per_hour = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--trace") == 0)
+            options.traces.push_back(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--outage-at") == 0)
+            options.outage_at_ms = atoll(argv[++i]) * 1000;
+        else if (i + 1 < argc && strcmp(argv[i], "--outage-for") == 0)
+            options.outage_for_ms = atoll(argv[++i]) * 1000;
+        else if (i + 1 < argc && strcmp(argv[i], "--outage") == 0)
+            options.server_outage = strcmp(argv[++i], "server") == 0;
+        else if (i + 1 < argc && strcmp(argv[i], "--loss") == 0)
+            options.loss = atof(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+            options.seed = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--log") == 0)
+            options.log = true;
+        else
+        {
+            fprintf(stderr, "usage: %s [--devices N] [--first-device N] [--duration S] [--speed X] [--host H] [--port N] [--path P]\n"
+                            "       [--remote-write-version 1|2] [--brews-per-hour N] [--knocks-per-hour N] [--trace trace.log]...\n"
+                            "       [--outage-at S] [--outage-for S] [--outage wifi|server] [--loss P] [--seed N] [--log]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (options.devices <= 0 || options.duration_ms <= 0 || options.speed < 0)
+    {
+        fprintf(stderr, "devices and duration must be positive, speed must not be negative\n");
+        return 1;
+    }
+    if (options.remote_write_version != 1 && options.remote_write_version != 2)
+    {
+        fprintf(stderr, "remote write version must be 1 or 2\n");
+        return 1;
+    }
+
+    std::vector<std::vector<Edge>> traces;
+    for (const char *path : options.traces)
+    {
+        traces.push_back(readTrace(path));
+    }
+    if (options.log)
+    {
+        Log::beginAsync(Serial);
+    }
+
+    // called by the send tasks, so the loss draws have their own generator
+    std::atomic<bool> server_down(false);
+    std::mutex loss_mutex;
+    std::mt19937 loss_rng(options.seed + 1);
+    std::bernoulli_distribution lost(options.loss);
+    WiFiClient::simulateUnreachable([&]()
+                                    {
+                                        if (server_down)
+                                            return true;
+                                        std::lock_guard<std::mutex> lock(loss_mutex);
+                                        return lost(loss_rng); });
+
+    std::mt19937 rng(options.seed);
+    // never destroyed, the endpoint tasks are only stopped by FreeRtosPosix::shutdown
+    std::vector<Device *> devices;
+    for (int i = 0; i < options.devices; i++)
+    {
+        devices.push_back(new Device(options.first_device + i, options, traces, rng));
+    }
+
+    bool wifi_up = true;
+    auto wall_start = std::chrono::steady_clock::now();
+    for (int64_t now_ms = 0; now_ms < options.duration_ms; now_ms += VIBRATION_POLL_INTERVAL_MS)
+    {
+        if (options.speed > 0)
+        {
+            std::this_thread::sleep_until(wall_start + std::chrono::microseconds((int64_t)(now_ms * 1000 / options.speed)));
+        }
+        bool in_outage = options.outage_at_ms >= 0 && now_ms >= options.outage_at_ms && now_ms < options.outage_at_ms + options.outage_for_ms;
+        if (options.server_outage)
+        {
+            server_down = in_outage;
+        }
+        else if (in_outage == wifi_up)
+        {
+            wifi_up = !in_outage;
+            for (Device *device : devices)
+            {
+                if (wifi_up)
+                    device->wifiRestored();
+                else
+                    device->wifiLost();
+            }
+        }
+
+        for (Device *device : devices)
+        {
+            device->step(now_ms);
+        }
+        // the send tasks post while the clock waits for them
+        FreeRtosPosix::advance(VIBRATION_POLL_INTERVAL_MS);
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    FreeRtosPosix::shutdown();
+
+    int64_t coffees = 0;
+    int64_t pushes = 0;
+    int64_t failures = 0;
+    for (Device *device : devices)
+    {
+        coffees += device->getCoffees();
+        pushes += device->getPushes();
+        failures += device->getFailures();
+    }
+    PosixHttpStats http = HttpClient::simulationStats();
+    printf("devices %d, simulated %.0f s in %.1f s wall time\n", options.devices, options.duration_ms / 1000.0, wall_s);
+    printf("coffees counted %lld\n", (long long)coffees);
+    printf("pushes %lld, requests %llu: %llu accepted, %llu rejected, %llu unreachable\n", (long long)pushes,
+           (unsigned long long)http.requests, (unsigned long long)http.succeeded, (unsigned long long)http.rejected,
+           (unsigned long long)http.unreachable);
+    printf("remote write failures %lld (ESP32_system_remote_write_failures_count of all devices)\n", (long long)failures);
+    printf("posted %llu bytes, %.1f requests/s\n", (unsigned long long)http.bytes, http.requests / wall_s);
+    printf("post latency p50 %.2f ms, p99 %.2f ms\n", percentile(http.latency_ms, 0.5), percentile(http.latency_ms, 0.99));
+    return 0;
+}
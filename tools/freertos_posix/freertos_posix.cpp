@@ -0,0 +1,621 @@
+#include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+
+/// @brief Thrown in a deleted task at its next kernel call to unwind its thread.
+/// Not a std::exception, so the firmware's catch blocks let it pass.
+struct TaskDeleted
+{
+};
+
+struct PosixTask
+{
+    std::string name;
+    void (*function)(void *);
+    void *args;
+    void *context;
+    std::thread thread;
+    bool deleted = false;
+    bool finished = false;
+    uint32_t notifications = 0;
+
+    // while blocked in a kernel call
+    bool blocked = false;
+    std::function<bool()> ready;
+    int64_t deadline_us = -1;
+};
+
+struct PosixSemaphore
+{
+    bool recursive;
+    uint32_t count;
+    std::thread::id owner;
+    uint32_t depth = 0;
+    uint64_t next_ticket = 0;
+    std::deque<uint64_t> waiting;
+    PosixSemaphoreStats stats = {};
+};
+
+struct PosixQueue
+{
+    UBaseType_t length;
+    UBaseType_t item_size;
+    std::deque<std::vector<uint8_t>> items;
+};
+
+namespace
+{
+    std::mutex kernel;
+    std::condition_variable changed;
+    std::atomic<int64_t> now_us(0);
+    std::atomic<int> pins[64];
+    // tasks that are not blocked in a kernel call, guarded by kernel
+    int running = 0;
+    std::vector<PosixTask *> tasks;
+    std::vector<PosixSemaphore *> semaphores;
+    // deadlines of threads that are not tasks while they wait, guarded by kernel
+    std::multiset<int64_t> thread_deadlines;
+    const char *next_label = "semaphore";
+    thread_local PosixTask *current_task = nullptr;
+    thread_local void *current_context = nullptr;
+
+    int64_t deadline(TickType_t ticks)
+    {
+        return ticks == portMAX_DELAY ? -1 : now_us + (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+    }
+
+    bool expired(int64_t deadline_us)
+    {
+        return deadline_us >= 0 && now_us >= deadline_us;
+    }
+
+    void checkDeleted()
+    {
+        if (current_task != nullptr && current_task->deleted)
+        {
+            throw TaskDeleted();
+        }
+    }
+
+    /// @brief Marks blocked tasks whose condition became true as running. Must hold kernel after every
+    /// change of kernel state, so advance never sees a task as blocked that is about to run.
+    void wakeReady()
+    {
+        for (PosixTask *task : tasks)
+        {
+            if (task->blocked && (task->deleted || expired(task->deadline_us) || task->ready()))
+            {
+                task->blocked = false;
+                running++;
+            }
+        }
+        changed.notify_all();
+    }
+
+    /// @brief Earliest deadline of a blocked task or waiting thread, INT64_MAX if none waits with a timeout. Must hold kernel.
+    int64_t nextDeadline()
+    {
+        int64_t next_us = INT64_MAX;
+        for (PosixTask *task : tasks)
+        {
+            if (task->blocked && task->deadline_us >= 0)
+            {
+                next_us = std::min(next_us, task->deadline_us);
+            }
+        }
+        auto thread_deadline = thread_deadlines.upper_bound(-1);
+        if (thread_deadline != thread_deadlines.end())
+        {
+            next_us = std::min(next_us, *thread_deadline);
+        }
+        return next_us;
+    }
+
+    /// @brief Blocks the calling thread until ready() returns true or the deadline passed. Must hold kernel.
+    /// @param deadline_us Virtual time in microseconds, -1 to wait forever.
+    /// @return false on timeout.
+    bool blockUntil(std::unique_lock<std::mutex> &lock, std::function<bool()> ready, int64_t deadline_us)
+    {
+        checkDeleted();
+        PosixTask *task = current_task;
+        while (!ready())
+        {
+            if (expired(deadline_us))
+            {
+                return false;
+            }
+            if (task == nullptr)
+            {
+                auto registered = thread_deadlines.insert(deadline_us);
+                changed.wait(lock);
+                thread_deadlines.erase(registered);
+                continue;
+            }
+            task->ready = ready;
+            task->deadline_us = deadline_us;
+            task->blocked = true;
+            running--;
+            changed.notify_all();
+            changed.wait(lock, [task]()
+                         { return !task->blocked; });
+            task->ready = nullptr;
+            checkDeleted();
+        }
+        return true;
+    }
+
+    BaseType_t take(PosixSemaphore *semaphore, TickType_t ticks)
+    {
+        std::unique_lock<std::mutex> lock(kernel);
+        checkDeleted();
+        semaphore->stats.takes++;
+        if (semaphore->count > 0 && semaphore->waiting.empty())
+        {
+            semaphore->count--;
+            return pdTRUE;
+        }
+        if (ticks == 0)
+        {
+            semaphore->stats.timeouts++;
+            return pdFALSE;
+        }
+
+        // served in FIFO order
+        uint64_t ticket = semaphore->next_ticket++;
+        semaphore->waiting.push_back(ticket);
+        semaphore->stats.contended++;
+        auto start = std::chrono::steady_clock::now();
+        bool taken;
+        try
+        {
+            taken = blockUntil(lock, [semaphore, ticket]()
+                               { return semaphore->count > 0 && semaphore->waiting.front() == ticket; },
+                               deadline(ticks));
+        }
+        catch (const TaskDeleted &)
+        {
+            semaphore->waiting.erase(std::find(semaphore->waiting.begin(), semaphore->waiting.end(), ticket));
+            wakeReady();
+            throw;
+        }
+        uint64_t wait_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        semaphore->stats.wait_ns += wait_ns;
+        semaphore->stats.max_wait_ns = std::max(semaphore->stats.max_wait_ns, wait_ns);
+        semaphore->waiting.erase(std::find(semaphore->waiting.begin(), semaphore->waiting.end(), ticket));
+        if (taken)
+        {
+            semaphore->count--;
+        }
+        else
+        {
+            semaphore->stats.timeouts++;
+        }
+        wakeReady();
+        return taken ? pdTRUE : pdFALSE;
+    }
+
+    SemaphoreHandle_t createSemaphore(bool recursive, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(kernel);
+        PosixSemaphore *semaphore = new PosixSemaphore();
+        semaphore->recursive = recursive;
+        semaphore->count = count;
+        semaphore->stats.label = next_label;
+        semaphores.push_back(semaphore);
+        return semaphore;
+    }
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*function)(void *), const char *name, uint32_t stack_depth, void *args,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    checkDeleted();
+    PosixTask *task = new PosixTask();
+    task->name = name;
+    task->function = function;
+    task->args = args;
+    task->context = current_context;
+    tasks.push_back(task);
+    running++;
+    if (handle != nullptr)
+    {
+        *handle = task;
+    }
+    // started while holding kernel, so shutdown never sees a task without its thread
+    task->thread = std::thread([task]()
+                               {
+                                   current_task = task;
+                                   current_context = task->context;
+                                   try
+                                   {
+                                       task->function(task->args);
+                                   }
+                                   catch (const TaskDeleted &)
+                                   {
+                                   }
+                                   std::lock_guard<std::mutex> lock(kernel);
+                                   task->finished = true;
+                                   running--;
+                                   wakeReady(); });
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == current_task)
+    {
+        throw TaskDeleted();
+    }
+    std::unique_lock<std::mutex> lock(kernel);
+    task->deleted = true;
+    wakeReady();
+    blockUntil(lock, [task]()
+               { return task->finished; },
+               -1);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(kernel);
+    blockUntil(lock, []()
+               { return false; },
+               deadline(ticks));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return now_us / 1000 / portTICK_PERIOD_MS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return current_task;
+}
+
+char *pcTaskGetName(TaskHandle_t task)
+{
+    return &(task != nullptr ? task : current_task)->name[0];
+}
+
+BaseType_t xPortGetCoreID()
+{
+    return 0;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    checkDeleted();
+    task->notifications++;
+    wakeReady();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(kernel);
+    PosixTask *task = current_task;
+    if (!blockUntil(lock, [task]()
+                    { return task->notifications > 0; },
+                    deadline(ticks)))
+    {
+        return 0;
+    }
+    uint32_t notifications = task->notifications;
+    task->notifications = clear_on_exit ? 0 : notifications - 1;
+    return notifications;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return createSemaphore(false, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return createSemaphore(false, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex()
+{
+    return createSemaphore(true, 1);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return take(semaphore, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    checkDeleted();
+    if (semaphore->count > 0)
+    {
+        // binary semaphores and mutexes hold at most one
+        return pdFALSE;
+    }
+    semaphore->count = 1;
+    wakeReady();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    {
+        std::lock_guard<std::mutex> lock(kernel);
+        if (semaphore->owner == std::this_thread::get_id())
+        {
+            semaphore->depth++;
+            return pdTRUE;
+        }
+    }
+    if (take(semaphore, ticks) != pdTRUE)
+    {
+        return pdFALSE;
+    }
+    std::lock_guard<std::mutex> lock(kernel);
+    semaphore->owner = std::this_thread::get_id();
+    semaphore->depth = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    checkDeleted();
+    if (semaphore->owner != std::this_thread::get_id())
+    {
+        return pdFALSE;
+    }
+    if (--semaphore->depth == 0)
+    {
+        semaphore->owner = std::thread::id();
+        semaphore->count = 1;
+        wakeReady();
+    }
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    semaphores.erase(std::find(semaphores.begin(), semaphores.end(), semaphore));
+    delete semaphore;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    PosixQueue *queue = new PosixQueue();
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(kernel);
+    if (!blockUntil(lock, [queue]()
+                    { return queue->items.size() < queue->length; },
+                    deadline(ticks)))
+    {
+        return pdFALSE;
+    }
+    const uint8_t *bytes = static_cast<const uint8_t *>(item);
+    queue->items.emplace_back(bytes, bytes + queue->item_size);
+    wakeReady();
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    std::unique_lock<std::mutex> lock(kernel);
+    if (!blockUntil(lock, [queue]()
+                    { return !queue->items.empty(); },
+                    deadline(ticks)))
+    {
+        return pdFALSE;
+    }
+    memcpy(item, queue->items.front().data(), queue->item_size);
+    queue->items.pop_front();
+    wakeReady();
+    return pdTRUE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    delete queue;
+}
+
+int64_t esp_timer_get_time()
+{
+    return now_us;
+}
+
+unsigned long millis()
+{
+    return now_us / 1000;
+}
+
+unsigned long micros()
+{
+    return now_us;
+}
+
+void delay(uint32_t ms)
+{
+    vTaskDelay(ms / portTICK_PERIOD_MS);
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+    pins[pin] = level;
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pins[pin];
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stdout);
+}
+
+/// @brief Moves the virtual clock forward one tick at a time. Before every tick, waits until all tasks
+/// ran up to their next blocking call, including tasks created since the last call. Ticks before the next
+/// deadline of a blocked task or thread are skipped, nothing can happen in them.
+void FreeRtosPosix::advance(uint32_t ms)
+{
+    std::unique_lock<std::mutex> lock(kernel);
+    int64_t end_us = now_us + (int64_t)(ms / portTICK_PERIOD_MS) * portTICK_PERIOD_MS * 1000;
+    while (true)
+    {
+        changed.wait(lock, []()
+                     { return running == 0; });
+        if (now_us >= end_us)
+        {
+            break;
+        }
+        int64_t next_us = std::max(now_us + portTICK_PERIOD_MS * 1000, std::min(end_us, nextDeadline()));
+        now_us = next_us;
+        wakeReady();
+    }
+}
+
+int64_t FreeRtosPosix::now()
+{
+    return now_us;
+}
+
+void FreeRtosPosix::setPin(uint8_t pin, int level)
+{
+    pins[pin] = level;
+}
+
+/// @brief Label for the contention statistics of semaphores created from now on.
+void FreeRtosPosix::labelNewSemaphores(const char *label)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    next_label = label;
+}
+
+size_t FreeRtosPosix::semaphoreCount()
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    return semaphores.size();
+}
+
+PosixSemaphoreStats FreeRtosPosix::semaphoreStats(size_t index)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    return semaphores[index]->stats;
+}
+
+/// @brief Prints contention per semaphore label, for labels with at least one take.
+void FreeRtosPosix::printSemaphoreStats(FILE *out)
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    std::vector<PosixSemaphoreStats> totals;
+    for (PosixSemaphore *semaphore : semaphores)
+    {
+        const PosixSemaphoreStats &stats = semaphore->stats;
+        auto total = std::find_if(totals.begin(), totals.end(), [&stats](const PosixSemaphoreStats &total)
+                                  { return strcmp(total.label, stats.label) == 0; });
+        if (total == totals.end())
+        {
+            totals.push_back(stats);
+            continue;
+        }
+        total->takes += stats.takes;
+        total->contended += stats.contended;
+        total->timeouts += stats.timeouts;
+        total->wait_ns += stats.wait_ns;
+        total->max_wait_ns = std::max(total->max_wait_ns, stats.max_wait_ns);
+    }
+    fprintf(out, "  %-24s %10s %10s %8s %12s %12s\n", "semaphore", "takes", "contended", "timeouts", "avg wait us", "max wait us");
+    for (const PosixSemaphoreStats &total : totals)
+    {
+        if (total.takes == 0)
+        {
+            continue;
+        }
+        fprintf(out, "  %-24s %10llu %9.1f%% %8llu %12.1f %12.1f\n", total.label, (unsigned long long)total.takes,
+                100.0 * total.contended / total.takes, (unsigned long long)total.timeouts,
+                total.contended > 0 ? total.wait_ns / 1000.0 / total.contended : 0.0, total.max_wait_ns / 1000.0);
+    }
+}
+
+void FreeRtosPosix::resetSemaphoreStats()
+{
+    std::lock_guard<std::mutex> lock(kernel);
+    for (PosixSemaphore *semaphore : semaphores)
+    {
+        const char *label = semaphore->stats.label;
+        semaphore->stats = {};
+        semaphore->stats.label = label;
+    }
+}
+
+/// @brief Deletes all tasks and joins their threads. Must not be called from a task.
+void FreeRtosPosix::shutdown()
+{
+    std::vector<PosixTask *> stopped;
+    {
+        std::unique_lock<std::mutex> lock(kernel);
+        for (PosixTask *task : tasks)
+        {
+            task->deleted = true;
+        }
+        wakeReady();
+        changed.wait(lock, []()
+                     { return std::all_of(tasks.begin(), tasks.end(), [](PosixTask *task)
+                                          { return task->finished; }); });
+        stopped.swap(tasks);
+    }
+    for (PosixTask *task : stopped)
+    {
+        task->thread.join();
+        delete task;
+    }
+}
+
+/// @brief Sets the context of the calling thread, inherited by the tasks it creates from now on.
+void FreeRtosPosix::setContext(void *context)
+{
+    current_context = context;
+}
+
+void *FreeRtosPosix::context()
+{
+    return current_context;
+}
@@ -0,0 +1,210 @@
+#include <ArduinoHttpClient.h>
+#include <PromLokiTransport.h>
+#include <chrono>
+
+static std::mutex stats_mutex;
+static PosixHttpStats stats = {};
+
+static int64_t steadyNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+HttpClient::HttpClient(Client &client, const char *server, uint16_t port)
+    : client(client), server(server), port(port)
+{
+}
+
+void HttpClient::setHttpResponseTimeout(uint32_t timeout)
+{
+    response_timeout = timeout;
+}
+
+void HttpClient::beginRequest()
+{
+    connect_failed = false;
+    body_bytes = 0;
+    start_ns = steadyNs();
+}
+
+/// @brief Connects and sends the request line. Later calls of the request are no-ops if the connect failed.
+/// @return HTTP_SUCCESS or HTTP_ERROR_CONNECTION_FAILED.
+int HttpClient::post(const char *path)
+{
+    if (!client.connect(server, port))
+    {
+        connect_failed = true;
+        return HTTP_ERROR_CONNECTION_FAILED;
+    }
+    client.printf("POST %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: Arduino/2.2.0\r\nConnection: close\r\n", path, server);
+    client.printf("X-Sim-Time-Ms: %lld\r\n", (long long)(PROM_LOKI_TRANSPORT_EPOCH_MS + esp_timer_get_time() / 1000));
+    return HTTP_SUCCESS;
+}
+
+void HttpClient::sendHeader(const char *name, const char *value)
+{
+    client.printf("%s: %s\r\n", name, value);
+}
+
+void HttpClient::sendHeader(const char *name, int value)
+{
+    client.printf("%s: %d\r\n", name, value);
+}
+
+void HttpClient::sendBasicAuth(const char *user, const char *password)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string credentials = std::string(user) + ":" + password;
+    std::string encoded;
+    for (size_t i = 0; i < credentials.size(); i += 3)
+    {
+        uint32_t group = (uint8_t)credentials[i] << 16;
+        size_t length = std::min((size_t)3, credentials.size() - i);
+        if (length > 1)
+            group |= (uint8_t)credentials[i + 1] << 8;
+        if (length > 2)
+            group |= (uint8_t)credentials[i + 2];
+        for (size_t j = 0; j < 4; j++)
+        {
+            encoded += j <= length ? alphabet[(group >> (18 - 6 * j)) & 0x3f] : '=';
+        }
+    }
+    sendHeader("Authorization", ("Basic " + encoded).c_str());
+}
+
+void HttpClient::beginBody()
+{
+    client.print("\r\n");
+}
+
+void HttpClient::endRequest()
+{
+    client.flush();
+}
+
+/// @return The status code of the answer, skipping 100 Continue, or a negative HTTP_ERROR_ code.
+int HttpClient::responseStatusCode()
+{
+    int status = HTTP_ERROR_CONNECTION_FAILED;
+    if (!connect_failed)
+    {
+        client.setTimeout(response_timeout);
+        std::string line;
+        status = HTTP_ERROR_TIMED_OUT;
+        while (readLine(line))
+        {
+            int code;
+            if (sscanf(line.c_str(), "HTTP/%*s %d", &code) != 1)
+            {
+                status = HTTP_ERROR_INVALID_RESPONSE;
+                break;
+            }
+            if (code != 100)
+            {
+                status = code;
+                break;
+            }
+            skipResponseHeaders();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.requests++;
+    if (status < 0)
+    {
+        stats.unreachable++;
+        return status;
+    }
+    if (status >= 200 && status < 300)
+    {
+        stats.succeeded++;
+    }
+    else
+    {
+        stats.rejected++;
+    }
+    stats.bytes += body_bytes;
+    stats.latency_ms.push_back((steadyNs() - start_ns) / 1e6);
+    return status;
+}
+
+/// @return HTTP_SUCCESS once the empty line after the headers was read.
+int HttpClient::skipResponseHeaders()
+{
+    std::string line;
+    while (readLine(line))
+    {
+        if (line.empty())
+        {
+            return HTTP_SUCCESS;
+        }
+    }
+    return HTTP_ERROR_TIMED_OUT;
+}
+
+int HttpClient::connect(const char *host, uint16_t port)
+{
+    return client.connect(host, port);
+}
+
+uint8_t HttpClient::connected()
+{
+    return client.connected();
+}
+
+void HttpClient::stop()
+{
+    client.stop();
+}
+
+size_t HttpClient::write(const uint8_t *buffer, size_t size)
+{
+    body_bytes += size;
+    return client.write(buffer, size);
+}
+
+int HttpClient::available()
+{
+    return client.available();
+}
+
+int HttpClient::read()
+{
+    return client.read();
+}
+
+int HttpClient::peek()
+{
+    return client.peek();
+}
+
+/// @brief Requests counted by all clients so far.
+PosixHttpStats HttpClient::simulationStats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    return stats;
+}
+
+/// @brief Reads a line without its CRLF.
+/// @return false if the connection closed or timed out before the end of the line.
+bool HttpClient::readLine(std::string &line)
+{
+    line.clear();
+    while (true)
+    {
+        int c = client.read();
+        if (c < 0)
+        {
+            return false;
+        }
+        if (c == '\n')
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            return true;
+        }
+        line += (char)c;
+    }
+}
@@ -0,0 +1,68 @@
+// Host replacement for ArduinoHttpClient, the request calls of RemoteWriteEndpoint over any Client.
+// Every request also carries the virtual time as Unix time of the fake PromLokiTransport in X-Sim-Time-Ms,
+// which tools/remote_write_receiver.py uses instead of its own clock. Requests are counted for the simulations,
+// see simulationStats.
+#ifndef FREERTOS_POSIX_ARDUINO_HTTP_CLIENT_INCLUDED
+#define FREERTOS_POSIX_ARDUINO_HTTP_CLIENT_INCLUDED
+
+#include <Arduino.h>
+#include <Client.h>
+#include <vector>
+
+#define HTTP_SUCCESS 0
+#define HTTP_ERROR_CONNECTION_FAILED -1
+#define HTTP_ERROR_TIMED_OUT -3
+#define HTTP_ERROR_INVALID_RESPONSE -4
+
+#define HTTP_HEADER_CONTENT_LENGTH "Content-Length"
+#define HTTP_HEADER_CONTENT_TYPE "Content-Type"
+
+struct PosixHttpStats
+{
+    uint64_t requests;
+    uint64_t succeeded;      // 2xx answers
+    uint64_t rejected;       // other answers
+    uint64_t unreachable;    // failed connects and missing answers
+    uint64_t bytes;          // bodies of answered requests
+    std::vector<double> latency_ms; // real time from connect to status, of answered requests
+};
+
+class HttpClient : public Client
+{
+public:
+    using Print::write;
+    HttpClient(Client &client, const char *server, uint16_t port = 80);
+    void setHttpResponseTimeout(uint32_t timeout);
+    void beginRequest();
+    int post(const char *path);
+    void sendHeader(const char *name, const char *value);
+    void sendHeader(const char *name, int value);
+    void sendBasicAuth(const char *user, const char *password);
+    void beginBody();
+    void endRequest();
+    int responseStatusCode();
+    int skipResponseHeaders();
+
+    int connect(const char *host, uint16_t port) override;
+    uint8_t connected() override;
+    void stop() override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    static PosixHttpStats simulationStats();
+
+private:
+    Client &client;
+    const char *server;
+    uint16_t port;
+    uint32_t response_timeout = 30000;
+    bool connect_failed = false;
+    size_t body_bytes = 0;
+    int64_t start_ns = 0;
+
+    bool readLine(std::string &line);
+};
+
+#endif
@@ -0,0 +1,15 @@
+// Host replacement for the Arduino Client interface, the calls HttpClient makes on its connection.
+#ifndef FREERTOS_POSIX_CLIENT_INCLUDED
+#define FREERTOS_POSIX_CLIENT_INCLUDED
+
+#include <Arduino.h>
+
+class Client : public Stream
+{
+public:
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+};
+
+#endif
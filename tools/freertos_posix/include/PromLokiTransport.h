@@ -0,0 +1,39 @@
+// Host replacement for PromLokiTransport. begin() connects the Wi-Fi like the original and then takes
+// PROM_LOKI_TRANSPORT_BEGIN_MS of virtual time for the NTP sync. The clock starts at a fixed Unix time.
+#ifndef FREERTOS_POSIX_PROM_LOKI_TRANSPORT_INCLUDED
+#define FREERTOS_POSIX_PROM_LOKI_TRANSPORT_INCLUDED
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define PROM_LOKI_TRANSPORT_BEGIN_MS 300
+#define PROM_LOKI_TRANSPORT_EPOCH_MS 1700000000000LL
+
+class PromLokiTransport
+{
+public:
+    void setUseTls(bool use_tls) {}
+    void setCerts(const char *certs, size_t length) {}
+    void setWifiSsid(const char *ssid) { this->ssid = ssid; }
+    void setWifiPass(const char *password) { this->password = password; }
+    void setDebug(Stream &stream) {}
+    bool begin()
+    {
+        WiFi.begin(ssid, password);
+        while (WiFi.status() != WL_CONNECTED)
+        {
+            vTaskDelay(100 / portTICK_PERIOD_MS);
+        }
+        vTaskDelay(PROM_LOKI_TRANSPORT_BEGIN_MS / portTICK_PERIOD_MS);
+        return true;
+    }
+    int64_t getTimeMillis() { return PROM_LOKI_TRANSPORT_EPOCH_MS + esp_timer_get_time() / 1000; }
+
+    char *errmsg = nullptr;
+
+private:
+    const char *ssid = nullptr;
+    const char *password = nullptr;
+};
+
+#endif
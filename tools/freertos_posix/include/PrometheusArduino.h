@@ -0,0 +1,19 @@
+// Host replacement for the PrometheusArduino declarations the firmware uses. Series are encoded by the
+// firmware's own Remote Write encoders, only the send result codes are left.
+#ifndef FREERTOS_POSIX_PROMETHEUS_ARDUINO_INCLUDED
+#define FREERTOS_POSIX_PROMETHEUS_ARDUINO_INCLUDED
+
+#include <Arduino.h>
+
+class PromClient
+{
+public:
+    enum SendResult
+    {
+        SUCCESS,
+        FAILED_RETRYABLE,
+        FAILED_DONT_RETRY
+    };
+};
+
+#endif
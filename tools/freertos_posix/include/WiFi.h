@@ -0,0 +1,86 @@
+// Host replacement for the ESP32 WiFi class. An access point that accepts every connection after a
+// configurable delay on the virtual clock; tests drop the connection with simulateDisconnect.
+// WiFi is the connection of the calling thread's context, see FreeRtosPosix::setContext, so every simulated
+// device can have its own. Threads without a context share one.
+#ifndef FREERTOS_POSIX_WIFI_INCLUDED
+#define FREERTOS_POSIX_WIFI_INCLUDED
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#define RTC_DATA_ATTR
+
+typedef enum
+{
+    WL_IDLE_STATUS = 0,
+    WL_CONNECTED = 3,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_WIFI_STA_GOT_IP = 7
+} arduino_event_id_t;
+
+typedef int arduino_event_info_t;
+
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0) : address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    operator uint32_t() const { return address; }
+
+private:
+    uint32_t address;
+};
+
+class WiFiClass
+{
+public:
+    typedef std::function<void(arduino_event_id_t, arduino_event_info_t)> EventHandler;
+
+    wl_status_t status();
+    int8_t RSSI();
+    uint8_t *BSSID();
+    int32_t channel();
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    wl_status_t begin(const char *ssid, const char *password, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+    bool config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress());
+    bool disconnect(bool wifi_off = false);
+    bool setAutoReconnect(bool reconnect);
+    int onEvent(EventHandler handler);
+
+    // test controls
+    void simulateConnectDelay(uint32_t ms, uint32_t fast_ms);
+    void simulateDisconnect();
+    void simulateRssi(int8_t dbm);
+    uint32_t getConnects();
+
+private:
+    std::mutex mutex;
+    std::vector<EventHandler> handlers;
+    wl_status_t state = WL_DISCONNECTED;
+    int64_t connected_at_us = -1;
+    uint32_t connect_delay_ms = 1000;
+    uint32_t fast_connect_delay_ms = 200;
+    uint32_t connects = 0;
+    int8_t rssi = -60;
+    uint8_t bssid[6] = {0x02, 0x00, 0x00, 0xc0, 0xff, 0xee};
+
+    void fire(arduino_event_id_t event);
+};
+
+/// @brief The WiFiClass passed to FreeRtosPosix::setContext by the calling thread or the creator of its task.
+WiFiClass &currentWiFi();
+#define WiFi currentWiFi()
+
+#endif
@@ -0,0 +1,34 @@
+// Host replacement for the ESP32 WiFiClient, a blocking TCP socket. Connecting takes no virtual time and only
+// succeeds while the WiFi of the calling thread is connected. Reads wait at most the stream timeout in real time.
+#ifndef FREERTOS_POSIX_WIFI_CLIENT_INCLUDED
+#define FREERTOS_POSIX_WIFI_CLIENT_INCLUDED
+
+#include <Client.h>
+#include <functional>
+
+class WiFiClient : public Client
+{
+public:
+    using Print::write;
+    ~WiFiClient() override;
+    int connect(const char *host, uint16_t port) override;
+    uint8_t connected() override;
+    void stop() override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    int peek() override;
+
+    // test controls
+    static void simulateUnreachable(std::function<bool()> unreachable);
+
+private:
+    int fd = -1;
+    uint8_t buffer[512];
+    size_t buffered = 0;
+    size_t position = 0;
+
+    bool fill(int timeout_ms);
+};
+
+#endif
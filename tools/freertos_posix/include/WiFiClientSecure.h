@@ -0,0 +1,13 @@
+// Host replacement for the ESP32 WiFiClientSecure. Connects in plain TCP, the certificate is ignored.
+#ifndef FREERTOS_POSIX_WIFI_CLIENT_SECURE_INCLUDED
+#define FREERTOS_POSIX_WIFI_CLIENT_SECURE_INCLUDED
+
+#include <WiFiClient.h>
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setCACert(const char *root_ca) {}
+};
+
+#endif
@@ -0,0 +1,12 @@
+// Host replacement for the RTC time of ESP-IDF. There is no deep sleep on the host, so it is the virtual clock.
+#ifndef FREERTOS_POSIX_ESP32_RTC_INCLUDED
+#define FREERTOS_POSIX_ESP32_RTC_INCLUDED
+
+#include <Arduino.h>
+
+inline uint64_t esp_rtc_get_time_us()
+{
+    return esp_timer_get_time();
+}
+
+#endif
@@ -0,0 +1,49 @@
+// FreeRTOS on POSIX threads with a virtual clock, for exercising the firmware's concurrency on the host.
+//
+// Every task created with xTaskCreatePinnedToCore runs on its own std::thread (pthreads). All kernel state, i.e.
+// semaphores, queues, notifications and the clock, is guarded by one mutex, so ThreadSanitizer sees every
+// give/take as a synchronization point, like on the device.
+//
+// Time only moves when FreeRtosPosix::advance is called. vTaskDelay and finite timeouts wait for virtual
+// ticks of 1 ms. After every tick, advance waits until all tasks are blocked again, so tasks polling at a fixed
+// interval run deterministically. Ticks in which no timeout expires are skipped, so idle tasks cost nothing.
+// Threads not created as tasks, e.g. test threads, may use the API as well but are not waited for.
+//
+// Semaphore waiters are served in FIFO order like equal priority tasks on FreeRTOS. Priorities and core
+// affinity are ignored. vTaskDelete of another task waits until that task reaches its next kernel call.
+//
+// Every thread carries a context pointer that the tasks it creates inherit, so a simulation can run several
+// devices in one process. The fake WiFi uses it to give every device its own connection, see WiFi.h.
+#ifndef FREERTOS_POSIX_INCLUDED
+#define FREERTOS_POSIX_INCLUDED
+
+#include <cstdint>
+#include <cstdio>
+
+struct PosixSemaphoreStats
+{
+    const char *label;
+    uint64_t takes;
+    uint64_t contended;   // takes that had to wait
+    uint64_t timeouts;
+    uint64_t wait_ns;     // real time spent waiting in contended takes
+    uint64_t max_wait_ns;
+};
+
+class FreeRtosPosix
+{
+public:
+    static void advance(uint32_t ms);
+    static int64_t now();
+    static void setPin(uint8_t pin, int level);
+    static void labelNewSemaphores(const char *label);
+    static size_t semaphoreCount();
+    static PosixSemaphoreStats semaphoreStats(size_t index);
+    static void printSemaphoreStats(FILE *out);
+    static void resetSemaphoreStats();
+    static void shutdown();
+    static void setContext(void *context);
+    static void *context();
+};
+
+#endif
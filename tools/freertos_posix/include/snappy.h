@@ -0,0 +1,35 @@
+// Host replacement for the snappy-c API of SnappyProto, backed by the block compressor of the host tools.
+#ifndef FREERTOS_POSIX_SNAPPY_INCLUDED
+#define FREERTOS_POSIX_SNAPPY_INCLUDED
+
+#include "../../common/snappy_block.h"
+
+struct snappy_env
+{
+};
+
+inline int snappy_init_env(struct snappy_env *env)
+{
+    return 0;
+}
+
+inline void snappy_free_env(struct snappy_env *env)
+{
+}
+
+inline size_t snappy_max_compressed_length(size_t source_len)
+{
+    return 32 + source_len + source_len / 6;
+}
+
+/// @param compressed_length Set to the length of the compressed data. compressed must hold
+/// snappy_max_compressed_length(length) bytes.
+inline int snappy_compress(struct snappy_env *env, const char *uncompressed, size_t length, char *compressed, size_t *compressed_length)
+{
+    std::string result = snappyCompress(std::string(uncompressed, length));
+    memcpy(compressed, result.data(), result.size());
+    *compressed_length = result.size();
+    return 0;
+}
+
+#endif
@@ -0,0 +1,666 @@
+// Multi-threaded stress tests of Prometheus_Histogram, Prometheus_Summary, Vibration and Transport on the host,
+// using the FreeRTOS-on-POSIX shim in this directory instead of the device.
+//
+// Build and run from the repository root, with ThreadSanitizer:
+//   g++ -std=gnu++17 -O1 -g -fsanitize=thread -Itools/freertos_posix/include -Iinclude tools/freertos_posix/*.cpp src/prometheus_histogram.cpp src/prometheus_summary.cpp src/quantile_sketch.cpp src/metric_series.cpp src/remote_write_encoder.cpp src/vibration.cpp src/vibration_detector.cpp src/transport.cpp src/wifi_connection.cpp src/log.cpp src/trace.cpp src/telemetry.cpp -o freertos_stress
+//   ./freertos_stress [--tasks N] [--values N] [--coffees N] [--drops N] [--seed N]
+//
+// Histogram and summary: --tasks tasks call AddValue --values times each, while a collector task runs Ingest
+// every tick and resetSamples whenever the series are full. Every ingested sample is checked against the
+// invariants, the final one against the exact totals.
+// Vibration: drives the sensor pin with --coffees random vibrations on the virtual clock and compares the
+// histogram with a replay of the same polls through VibrationDetector.
+// Transport: drops the Wi-Fi --drops times while tasks call isInitialized and getTimeMillis.
+//
+// Exits with 1 if a check failed. ThreadSanitizer reports data races separately and exits with 66.
+
+#include "config.h"
+#include <freertos_posix.h>
+#include <prometheus_histogram.h>
+#include <prometheus_summary.h>
+#include <vibration.h>
+#include <transport.h>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#define STRESS_BATCH_SIZE 64
+#define STRESS_SERIES_SIZE 10
+
+static std::atomic<int> failures(0);
+
+static void fail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+static void fail(const char *format, ...)
+{
+    // the first failures are enough to debug, the rest would only flood the output
+    if (failures++ >= 20)
+    {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "FAIL: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+/// @brief Discards the log, which is drained as on the device to exercise the ring buffer.
+class NullStream : public Stream
+{
+public:
+    size_t write(const uint8_t *buffer, size_t size) override { return size; }
+};
+
+static NullStream log_stream;
+
+static double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string addLabel(const char *labels, const std::string &label)
+{
+    std::string result = labels;
+    result.insert(result.find_last_of('}'), "," + label);
+    return result;
+}
+
+/// @brief Encoder that keeps the series passed to it, so the test reads back exactly what a push would send.
+class CaptureEncoder : public RemoteWriteEncoder
+{
+public:
+    CaptureEncoder() : RemoteWriteEncoder(0) {}
+    void reset() override
+    {
+        RemoteWriteEncoder::reset();
+        series.clear();
+    }
+    bool addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count) override
+    {
+        series.push_back({name, labels, std::vector<double>(values, values + count)});
+        return true;
+    }
+    uint8_t remoteWriteVersion() override { return 1; }
+
+    /// @brief Samples of the series with the given name and labels, nullptr if it was not encoded.
+    const std::vector<double> *find(const std::string &name, const std::string &labels) const
+    {
+        for (const Series &s : series)
+        {
+            if (s.name == name && s.labels == labels)
+                return &s.values;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Series
+    {
+        std::string name;
+        std::string labels;
+        std::vector<double> values;
+    };
+    std::vector<Series> series;
+};
+
+static bool lastValue(const CaptureEncoder &capture, const std::string &name, const std::string &labels, double &value)
+{
+    const std::vector<double> *values = capture.find(name, labels);
+    if (values == nullptr || values->empty())
+    {
+        fail("%s%s has no samples", name.c_str(), labels.c_str());
+        return false;
+    }
+    value = values->back();
+    return true;
+}
+
+/// @brief Number of samples of a series, series without samples are left out of the request.
+static size_t sampleCount(const CaptureEncoder &capture, const std::string &name, const std::string &labels)
+{
+    const std::vector<double> *values = capture.find(name, labels);
+    return values != nullptr ? values->size() : 0;
+}
+
+/// @brief Series of a Prometheus_Histogram, read back by encoding them.
+struct HistogramView
+{
+    Prometheus_Histogram *histogram;
+    std::string name;
+    const char *labels;
+    int64_t start;
+    int64_t increment;
+    int bucket_count;
+
+    struct Snapshot
+    {
+        std::vector<double> buckets; // cumulative finite buckets followed by +Inf
+        double count;
+        double sum;
+        size_t samples; // samples per series since the last reset
+    };
+
+    bool read(Snapshot &snapshot) const
+    {
+        CaptureEncoder capture;
+        histogram->encode(capture);
+        snapshot.buckets.resize(bucket_count + 1);
+        snapshot.samples = sampleCount(capture, name + "_count", labels);
+        bool ok = lastValue(capture, name + "_count", labels, snapshot.count) && lastValue(capture, name + "_sum", labels, snapshot.sum);
+        for (int i = 0; i <= bucket_count && ok; i++)
+        {
+            std::string le = i < bucket_count ? std::to_string(start + i * increment) : "+Inf";
+            ok = lastValue(capture, name + "_bucket", addLabel(labels, "le=\"" + le + "\""), snapshot.buckets[i]);
+        }
+        return ok;
+    }
+
+    /// @brief Expected snapshot after adding values. Buckets are cumulative, +Inf counts every value.
+    Snapshot expect(const std::vector<int64_t> &values) const
+    {
+        Snapshot snapshot = {std::vector<double>(bucket_count + 1, 0), 0, 0, 0};
+        for (int64_t value : values)
+        {
+            for (int i = 0; i < bucket_count; i++)
+            {
+                if (value <= start + i * increment)
+                {
+                    snapshot.buckets[i]++;
+                }
+            }
+            snapshot.buckets[bucket_count]++;
+            snapshot.count++;
+            snapshot.sum += value;
+        }
+        return snapshot;
+    }
+
+    /// @brief Checks one ingested sample, and that count and sum did not decrease since the previous one.
+    void check(const Snapshot &snapshot, const Snapshot &previous) const
+    {
+        for (int i = 1; i <= bucket_count; i++)
+        {
+            if (snapshot.buckets[i] < snapshot.buckets[i - 1])
+            {
+                fail("%s bucket %d has %.0f, less than bucket %d with %.0f", name.c_str(), i, snapshot.buckets[i], i - 1, snapshot.buckets[i - 1]);
+            }
+        }
+        if (snapshot.buckets[bucket_count] != snapshot.count)
+        {
+            fail("%s +Inf bucket %.0f is not count %.0f", name.c_str(), snapshot.buckets[bucket_count], snapshot.count);
+        }
+        if (snapshot.count < previous.count || snapshot.sum < previous.sum)
+        {
+            fail("%s went back from count %.0f sum %.0f to count %.0f sum %.0f", name.c_str(), previous.count, previous.sum, snapshot.count, snapshot.sum);
+        }
+    }
+
+    void checkEqual(const Snapshot &snapshot, const Snapshot &expected) const
+    {
+        if (snapshot.count != expected.count || snapshot.sum != expected.sum)
+        {
+            fail("%s has count %.0f sum %.0f, expected count %.0f sum %.0f", name.c_str(), snapshot.count, snapshot.sum, expected.count, expected.sum);
+        }
+        for (int i = 0; i <= bucket_count; i++)
+        {
+            if (snapshot.buckets[i] != expected.buckets[i])
+            {
+                fail("%s bucket %d has %.0f, expected %.0f", name.c_str(), i, snapshot.buckets[i], expected.buckets[i]);
+            }
+        }
+    }
+};
+
+struct HammerArgs
+{
+    Prometheus_Histogram *histogram;
+    Prometheus_Summary *summary;
+    const std::vector<int64_t> *values;
+    std::atomic<int> *done;
+};
+
+/// @brief Adds its values and waits a tick after every batch, like a sensor task.
+static void hammerTask(void *args)
+{
+    HammerArgs *hammer = static_cast<HammerArgs *>(args);
+    for (size_t i = 0; i < hammer->values->size(); i++)
+    {
+        if (hammer->histogram != nullptr)
+            hammer->histogram->AddValue((*hammer->values)[i]);
+        if (hammer->summary != nullptr)
+            hammer->summary->AddValue((*hammer->values)[i]);
+        if (i % STRESS_BATCH_SIZE == STRESS_BATCH_SIZE - 1)
+            vTaskDelay(1);
+    }
+    (*hammer->done)++;
+    vTaskDelete(NULL);
+}
+
+struct HistogramCollectorArgs
+{
+    Prometheus_Histogram *histogram;
+    const HistogramView *view;
+    TickType_t interval;
+    std::atomic<bool> stop;
+    std::atomic<bool> stopped;
+    uint32_t ingests;
+    uint32_t resets;
+};
+
+/// @brief Ingests and checks every interval, resetting the series when they are full like a push would.
+static void histogramCollectorTask(void *args)
+{
+    HistogramCollectorArgs *collector = static_cast<HistogramCollectorArgs *>(args);
+    HistogramView::Snapshot previous = {std::vector<double>(collector->view->bucket_count + 1, 0), 0, 0, 0};
+    while (!collector->stop)
+    {
+        collector->histogram->Ingest(millis());
+        collector->ingests++;
+        HistogramView::Snapshot snapshot;
+        if (collector->view->read(snapshot))
+        {
+            collector->view->check(snapshot, previous);
+            previous = snapshot;
+        }
+        if (snapshot.samples == STRESS_SERIES_SIZE)
+        {
+            collector->histogram->resetSamples();
+            collector->resets++;
+        }
+        vTaskDelay(collector->interval);
+    }
+    collector->stopped = true;
+    vTaskDelete(NULL);
+}
+
+static std::vector<std::vector<int64_t>> hammerValues(int tasks, int count, int64_t min, int64_t max, std::mt19937 &random)
+{
+    std::uniform_int_distribution<int64_t> distribution(min, max);
+    std::vector<std::vector<int64_t>> values(tasks);
+    for (std::vector<int64_t> &task_values : values)
+    {
+        for (int i = 0; i < count; i++)
+            task_values.push_back(distribution(random));
+    }
+    return values;
+}
+
+static void runUntil(const std::atomic<int> &done, int count)
+{
+    while (done < count)
+    {
+        FreeRtosPosix::advance(1);
+    }
+}
+
+static void stopCollector(std::atomic<bool> &stop, const std::atomic<bool> &stopped)
+{
+    stop = true;
+    while (!stopped)
+    {
+        FreeRtosPosix::advance(1);
+    }
+}
+
+static void histogramStress(int tasks, int count, std::mt19937 &random)
+{
+    const char *labels = "{test=\"histogram\"}";
+    FreeRtosPosix::labelNewSemaphores("histogram update");
+    Prometheus_Histogram histogram("stress_histogram", labels, STRESS_SERIES_SIZE, 0, 1000, 12);
+    histogram.init();
+    HistogramView view = {&histogram, "stress_histogram", labels, 0, 1000, 12};
+
+    // values above the largest finite bucket are only counted by +Inf
+    std::vector<std::vector<int64_t>> values = hammerValues(tasks, count, 0, 13000, random);
+    std::vector<int64_t> all_values;
+    for (const std::vector<int64_t> &task_values : values)
+        all_values.insert(all_values.end(), task_values.begin(), task_values.end());
+
+    std::atomic<int> done(0);
+    std::vector<HammerArgs> hammers(tasks);
+    HistogramCollectorArgs collector = {&histogram, &view, 1, {false}, {false}, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+    xTaskCreatePinnedToCore(histogramCollectorTask, "collector", 4096, &collector, 2, NULL, tskNO_AFFINITY);
+    for (int i = 0; i < tasks; i++)
+    {
+        hammers[i] = {&histogram, nullptr, &values[i], &done};
+        xTaskCreatePinnedToCore(hammerTask, "hammer", 4096, &hammers[i], 3, NULL, tskNO_AFFINITY);
+    }
+    runUntil(done, tasks);
+    double elapsed = seconds(start);
+    stopCollector(collector.stop, collector.stopped);
+
+    histogram.Ingest(millis());
+    HistogramView::Snapshot snapshot;
+    if (view.read(snapshot))
+    {
+        view.checkEqual(snapshot, view.expect(all_values));
+    }
+    printf("histogram: %d tasks x %d AddValue in %.2f s (%.0f/s), %u ingests, %u resets\n",
+           tasks, count, elapsed, tasks * count / elapsed, collector.ingests, collector.resets);
+}
+
+struct SummaryCollectorArgs
+{
+    Prometheus_Summary *summary;
+    const char *name;
+    const char *labels;
+    const double *quantiles;
+    int quantile_count;
+    int64_t min;
+    int64_t max;
+    std::atomic<bool> stop;
+    std::atomic<bool> stopped;
+    uint32_t ingests;
+};
+
+/// @return Number of samples per series since the last reset.
+static size_t checkSummary(SummaryCollectorArgs &collector, CaptureEncoder &capture, double &previous_count)
+{
+    capture.reset();
+    collector.summary->encode(capture);
+    double count;
+    if (lastValue(capture, std::string(collector.name) + "_count", collector.labels, count))
+    {
+        if (count < previous_count)
+            fail("%s count went back from %.0f to %.0f", collector.name, previous_count, count);
+        previous_count = count;
+    }
+    for (int i = 0; i < collector.quantile_count; i++)
+    {
+        char label[24];
+        snprintf(label, sizeof(label), "quantile=\"%g\"", collector.quantiles[i]);
+        double value;
+        // NaN while the window is empty
+        if (lastValue(capture, collector.name, addLabel(collector.labels, label), value) &&
+            !std::isnan(value) && (value < collector.min || value > collector.max))
+        {
+            fail("%s quantile %g is %.1f, outside of the added values [%lld, %lld]", collector.name, collector.quantiles[i],
+                 value, (long long)collector.min, (long long)collector.max);
+        }
+    }
+    return sampleCount(capture, std::string(collector.name) + "_count", collector.labels);
+}
+
+static void summaryCollectorTask(void *args)
+{
+    SummaryCollectorArgs *collector = static_cast<SummaryCollectorArgs *>(args);
+    CaptureEncoder capture;
+    double previous_count = 0;
+    while (!collector->stop)
+    {
+        collector->summary->Ingest(millis());
+        collector->ingests++;
+        if (checkSummary(*collector, capture, previous_count) == STRESS_SERIES_SIZE)
+        {
+            collector->summary->resetSamples();
+        }
+        vTaskDelay(1);
+    }
+    collector->stopped = true;
+    vTaskDelete(NULL);
+}
+
+static void summaryStress(int tasks, int count, std::mt19937 &random)
+{
+    static const double quantiles[] = {0.5, 0.9, 0.99};
+    const char *name = "stress_summary";
+    const char *labels = "{test=\"summary\"}";
+    FreeRtosPosix::labelNewSemaphores("summary update");
+    // slices of 250 ms, so the window moves while the tasks add values
+    Prometheus_Summary summary(name, labels, STRESS_SERIES_SIZE, quantiles, 3, 1, 4, BREW_DURATION_COMPRESSION);
+    summary.init();
+
+    std::vector<std::vector<int64_t>> values = hammerValues(tasks, count, 100, 5000, random);
+    double expected_sum = 0;
+    for (const std::vector<int64_t> &task_values : values)
+        for (int64_t value : task_values)
+            expected_sum += value;
+
+    std::atomic<int> done(0);
+    std::vector<HammerArgs> hammers(tasks);
+    SummaryCollectorArgs collector = {&summary, name, labels, quantiles, 3, 100, 5000, {false}, {false}, 0};
+    auto start = std::chrono::steady_clock::now();
+    xTaskCreatePinnedToCore(summaryCollectorTask, "collector", 4096, &collector, 2, NULL, tskNO_AFFINITY);
+    for (int i = 0; i < tasks; i++)
+    {
+        hammers[i] = {nullptr, &summary, &values[i], &done};
+        xTaskCreatePinnedToCore(hammerTask, "hammer", 4096, &hammers[i], 3, NULL, tskNO_AFFINITY);
+    }
+    runUntil(done, tasks);
+    double elapsed = seconds(start);
+    stopCollector(collector.stop, collector.stopped);
+
+    summary.Ingest(millis());
+    CaptureEncoder capture;
+    double previous_count = 0;
+    checkSummary(collector, capture, previous_count);
+    double sum;
+    if (lastValue(capture, std::string(name) + "_sum", labels, sum) && (previous_count != (double)tasks * count || sum != expected_sum))
+    {
+        fail("%s has count %.0f sum %.0f, expected count %d sum %.0f", name, previous_count, sum, tasks * count, expected_sum);
+    }
+    printf("summary: %d tasks x %d AddValue in %.2f s (%.0f/s), %u ingests\n", tasks, count, elapsed, tasks * count / elapsed, collector.ingests);
+}
+
+static void vibrationStress(int coffees, std::mt19937 &random)
+{
+    const int32_t threshold_ms = 2000;
+    const char *labels = "{test=\"vibration\"}";
+    FreeRtosPosix::labelNewSemaphores("vibration histogram");
+    Prometheus_Histogram histogram("stress_coffees_consumed", labels, STRESS_SERIES_SIZE, 2000, 1000, 5);
+    histogram.init();
+    HistogramView view = {&histogram, "stress_coffees_consumed", labels, 2000, 1000, 5};
+
+    // the sensor pulls the pin low while vibrating
+    struct Edge
+    {
+        int64_t time_ms;
+        int level;
+    };
+    std::vector<Edge> edges;
+    std::uniform_int_distribution<int64_t> idle(1, 3000);
+    std::uniform_int_distribution<int64_t> vibration(1, 6000);
+    FreeRtosPosix::setPin(VIBRATION_SENSOR_PIN, HIGH);
+    int64_t start_ms = FreeRtosPosix::now() / 1000;
+    int64_t time_ms = start_ms;
+    for (int i = 0; i < coffees; i++)
+    {
+        time_ms += idle(random);
+        edges.push_back({time_ms, LOW});
+        time_ms += vibration(random);
+        edges.push_back({time_ms, HIGH});
+    }
+    int64_t end_ms = time_ms + 2 * VIBRATION_POLL_INTERVAL_MS;
+
+    HistogramCollectorArgs collector = {&histogram, &view, 500 / portTICK_PERIOD_MS, {false}, {false}, 0, 0};
+    {
+        Vibration vibration_task(threshold_ms, &histogram);
+        vibration_task.beginAsync();
+        xTaskCreatePinnedToCore(histogramCollectorTask, "collector", 4096, &collector, 2, NULL, tskNO_AFFINITY);
+        for (const Edge &edge : edges)
+        {
+            FreeRtosPosix::advance(edge.time_ms - FreeRtosPosix::now() / 1000);
+            FreeRtosPosix::setPin(VIBRATION_SENSOR_PIN, edge.level);
+        }
+        FreeRtosPosix::advance(end_ms - FreeRtosPosix::now() / 1000);
+        stopCollector(collector.stop, collector.stopped);
+        // deletes the polling task while it waits for the next poll
+    }
+
+    // The task polls at start_ms and every poll interval after. A level set at time t is seen by the
+    // polls after t, since advance returns only after the poll at t ran.
+    VibrationDetector detector(threshold_ms);
+    std::vector<int64_t> durations;
+    size_t next_edge = 0;
+    int level = HIGH;
+    for (int64_t poll_ms = start_ms; poll_ms <= end_ms; poll_ms += VIBRATION_POLL_INTERVAL_MS)
+    {
+        while (next_edge < edges.size() && edges[next_edge].time_ms < poll_ms)
+            level = edges[next_edge++].level;
+        VibrationEvent event;
+        if (detector.update(poll_ms, level == LOW, event) && event.counted)
+            durations.push_back(event.duration_ms);
+    }
+
+    histogram.Ingest(millis());
+    HistogramView::Snapshot snapshot;
+    if (view.read(snapshot))
+    {
+        view.checkEqual(snapshot, view.expect(durations));
+    }
+    printf("vibration: %d vibrations, %zu counted over %.0f virtual s, %u ingests\n",
+           coffees, durations.size(), (end_ms - start_ms) / 1000.0, collector.ingests);
+}
+
+struct TimeArgs
+{
+    Transport *transport;
+    std::atomic<bool> *stop;
+    std::atomic<int> *initialized;
+    std::atomic<int> *stopped;
+    uint32_t calls;
+};
+
+/// @brief Reads the time every tick once the transport is up, like the main loop and the send tasks.
+static void timeTask(void *args)
+{
+    TimeArgs *time = static_cast<TimeArgs *>(args);
+    int64_t previous = 0;
+    bool initialized = false;
+    while (!*time->stop)
+    {
+        if (time->transport->isInitialized())
+        {
+            if (!initialized)
+                (*time->initialized)++;
+            initialized = true;
+            int64_t now = time->transport->getTimeMillis();
+            if (now < PROM_LOKI_TRANSPORT_EPOCH_MS || now < previous)
+                fail("getTimeMillis returned %lld after %lld", (long long)now, (long long)previous);
+            previous = now;
+            time->calls++;
+        }
+        else if (initialized)
+        {
+            fail("transport is no longer initialized");
+        }
+        vTaskDelay(1);
+    }
+    (*time->stopped)++;
+    vTaskDelete(NULL);
+}
+
+static void advanceUntilConnects(uint32_t connects)
+{
+    while (WiFi.getConnects() < connects)
+    {
+        FreeRtosPosix::advance(1);
+    }
+}
+
+static void transportStress(int tasks, int drops, std::mt19937 &random)
+{
+    const char *labels = "{test=\"transport\"}";
+    FreeRtosPosix::labelNewSemaphores("wifi connect histogram");
+    Prometheus_Histogram connect_duration("stress_wifi_connect_duration_ms", labels, STRESS_SERIES_SIZE, 100, 100, 5);
+    connect_duration.init();
+    HistogramView view = {&connect_duration, "stress_wifi_connect_duration_ms", labels, 100, 100, 5};
+
+    WiFi.simulateConnectDelay(1500, 200);
+    FreeRtosPosix::labelNewSemaphores("transport");
+    // never deleted, like on the device
+    Transport *transport = new Transport(WIFI_STATUS_LED_VCC, "stress", "stress");
+    transport->setConnectDurationHistogram(&connect_duration);
+    transport->beginAsync();
+
+    std::atomic<bool> stop(false);
+    std::atomic<int> initialized(0);
+    std::atomic<int> stopped(0);
+    std::vector<TimeArgs> times(tasks);
+    for (int i = 0; i < tasks; i++)
+    {
+        times[i] = {transport, &stop, &initialized, &stopped, 0};
+        xTaskCreatePinnedToCore(timeTask, "time", 4096, &times[i], 2, NULL, tskNO_AFFINITY);
+    }
+    runUntil(initialized, tasks);
+
+    // reconnects go through the fast path, alternating between a good and a bad signal to start and
+    // delete the LED blink task
+    std::uniform_int_distribution<int> connected_ms(1, 3000);
+    for (int i = 0; i < drops; i++)
+    {
+        advanceUntilConnects(i + 1);
+        FreeRtosPosix::advance(connected_ms(random));
+        WiFi.simulateRssi(i % 2 == 0 ? -80 : -60);
+        WiFi.simulateDisconnect();
+    }
+    advanceUntilConnects(drops + 1);
+    FreeRtosPosix::advance(1000);
+    stop = true;
+    runUntil(stopped, tasks);
+
+    connect_duration.Ingest(millis());
+    HistogramView::Snapshot snapshot;
+    if (view.read(snapshot) && snapshot.count != drops)
+    {
+        fail("%s has count %.0f, expected one reconnect per drop: %d", view.name.c_str(), snapshot.count, drops);
+    }
+    if (transport->getWifiFastConnectFailures() != 0)
+    {
+        fail("%d fast connects failed", transport->getWifiFastConnectFailures());
+    }
+    uint32_t calls = 0;
+    for (const TimeArgs &time : times)
+        calls += time.calls;
+    printf("transport: %d drops, %d tasks with %u getTimeMillis calls over %.0f virtual s\n",
+           drops, tasks, calls, FreeRtosPosix::now() / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    int tasks = 8;
+    int values = 20000;
+    int coffees = 40;
+    int drops = 10;
+    unsigned int seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--tasks") == 0)
+            tasks = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--values") == 0)
+            values = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--coffees") == 0)
+            coffees = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--drops") == 0)
+            drops = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--seed") == 0)
+            seed = strtoul(argv[++i], nullptr, 10);
+        else
+        {
+            fprintf(stderr, "usage: %s [--tasks N] [--values N] [--coffees N] [--drops N] [--seed N]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::mt19937 random(seed);
+    Log::beginAsync(log_stream);
+
+    histogramStress(tasks, values, random);
+    FreeRtosPosix::printSemaphoreStats(stdout);
+    FreeRtosPosix::resetSemaphoreStats();
+
+    // the sketches make AddValue slower, fewer values are enough
+    summaryStress(tasks, values / 4, random);
+    FreeRtosPosix::printSemaphoreStats(stdout);
+    FreeRtosPosix::resetSemaphoreStats();
+
+    vibrationStress(coffees, random);
+    transportStress(tasks, drops, random);
+    FreeRtosPosix::printSemaphoreStats(stdout);
+
+    FreeRtosPosix::shutdown();
+    printf("%s, %u log messages dropped\n", failures == 0 ? "passed" : "FAILED", Log::getDropped());
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include <WiFi.h>
+
+// connection of threads without a context
+static WiFiClass shared_wifi;
+
+WiFiClass &currentWiFi()
+{
+    void *context = FreeRtosPosix::context();
+    return context != nullptr ? *static_cast<WiFiClass *>(context) : shared_wifi;
+}
+
+/// @brief Completes a pending connect once its delay passed on the virtual clock.
+wl_status_t WiFiClass::status()
+{
+    bool got_ip = false;
+    wl_status_t result;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (state != WL_CONNECTED && connected_at_us >= 0 && esp_timer_get_time() >= connected_at_us)
+        {
+            state = WL_CONNECTED;
+            connects++;
+            got_ip = true;
+        }
+        result = state;
+    }
+    if (got_ip)
+    {
+        fire(ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    }
+    return result;
+}
+
+int8_t WiFiClass::RSSI()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return rssi;
+}
+
+uint8_t *WiFiClass::BSSID()
+{
+    return bssid;
+}
+
+int32_t WiFiClass::channel()
+{
+    return 6;
+}
+
+IPAddress WiFiClass::localIP()
+{
+    return IPAddress(192, 168, 1, 42);
+}
+
+IPAddress WiFiClass::gatewayIP()
+{
+    return IPAddress(192, 168, 1, 1);
+}
+
+IPAddress WiFiClass::subnetMask()
+{
+    return IPAddress(255, 255, 255, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index)
+{
+    return IPAddress(192, 168, 1, 1);
+}
+
+/// @brief Starts connecting. With a BSSID the scan is skipped and the connect takes the fast delay.
+wl_status_t WiFiClass::begin(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid, bool connect)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    connected_at_us = esp_timer_get_time() + (int64_t)(bssid != nullptr ? fast_connect_delay_ms : connect_delay_ms) * 1000;
+    return state;
+}
+
+bool WiFiClass::config(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns)
+{
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifi_off)
+{
+    bool was_connected;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        was_connected = state == WL_CONNECTED;
+        state = WL_DISCONNECTED;
+        connected_at_us = -1;
+    }
+    if (was_connected)
+    {
+        fire(ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+    }
+    return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool reconnect)
+{
+    return true;
+}
+
+int WiFiClass::onEvent(EventHandler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    handlers.push_back(handler);
+    return handlers.size();
+}
+
+void WiFiClass::simulateConnectDelay(uint32_t ms, uint32_t fast_ms)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    connect_delay_ms = ms;
+    fast_connect_delay_ms = fast_ms;
+}
+
+/// @brief Drops the connection like a lost access point, firing the disconnect event on the calling thread.
+void WiFiClass::simulateDisconnect()
+{
+    disconnect();
+}
+
+void WiFiClass::simulateRssi(int8_t dbm)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    rssi = dbm;
+}
+
+uint32_t WiFiClass::getConnects()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return connects;
+}
+
+/// @brief Calls the event handlers without holding the mutex, they call back into WiFi.
+void WiFiClass::fire(arduino_event_id_t event)
+{
+    std::vector<EventHandler> current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = handlers;
+    }
+    for (EventHandler &handler : current)
+    {
+        handler(event, 0);
+    }
+}
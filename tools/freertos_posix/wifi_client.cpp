@@ -0,0 +1,129 @@
+#include <WiFi.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// set before any task connects
+static std::function<bool()> unreachable;
+
+WiFiClient::~WiFiClient()
+{
+    stop();
+}
+
+/// @return 1 if connected, 0 if the Wi-Fi is down, simulateUnreachable says so or the host does not answer.
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    stop();
+    if (WiFi.status() != WL_CONNECTED || (unreachable && unreachable()))
+    {
+        return 0;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *address;
+    if (getaddrinfo(host, std::to_string(port).c_str(), &hints, &address) != 0)
+    {
+        return 0;
+    }
+    fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd >= 0 && ::connect(fd, address->ai_addr, address->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(address);
+    return fd >= 0 ? 1 : 0;
+}
+
+uint8_t WiFiClient::connected()
+{
+    return fd >= 0 || position < buffered;
+}
+
+void WiFiClient::stop()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    buffered = 0;
+    position = 0;
+}
+
+size_t WiFiClient::write(const uint8_t *data, size_t size)
+{
+    size_t written = 0;
+    while (fd >= 0 && written < size)
+    {
+        ssize_t n = send(fd, data + written, size - written, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            stop();
+            break;
+        }
+        written += n;
+    }
+    return written;
+}
+
+int WiFiClient::available()
+{
+    if (position == buffered)
+    {
+        fill(0);
+    }
+    return buffered - position;
+}
+
+int WiFiClient::read()
+{
+    if (position == buffered && !fill(timeout))
+    {
+        return -1;
+    }
+    return buffer[position++];
+}
+
+int WiFiClient::peek()
+{
+    if (position == buffered && !fill(timeout))
+    {
+        return -1;
+    }
+    return buffer[position];
+}
+
+/// @brief Makes connects fail like an unreachable host while the callback returns true. It is called by the
+/// connecting task, so it must be thread safe. Must be set before the first task connects.
+void WiFiClient::simulateUnreachable(std::function<bool()> callback)
+{
+    unreachable = callback;
+}
+
+/// @brief Reads what arrived within timeout_ms into the empty buffer.
+/// @return false on timeout or when the connection was closed.
+bool WiFiClient::fill(int timeout_ms)
+{
+    if (fd < 0)
+    {
+        return false;
+    }
+    pollfd readable = {fd, POLLIN, 0};
+    if (poll(&readable, 1, timeout_ms) <= 0)
+    {
+        return false;
+    }
+    ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0)
+    {
+        stop();
+        return false;
+    }
+    buffered = n;
+    position = 0;
+    return true;
+}
@@ -0,0 +1,83 @@
+// Host benchmark of QuantileSketch: insert cost, memory and accuracy for several compressions.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -Iinclude tools/quantile_bench/quantile_bench.cpp src/quantile_sketch.cpp -o quantile_bench
+//   ./quantile_bench [values per run]
+//
+// Accuracy is reported as the rank error of the estimate, i.e. how far the true quantile of the
+// estimated value is from the requested quantile.
+
+#include "quantile_sketch.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+struct Distribution
+{
+    const char *name;
+    std::function<double(std::mt19937 &)> sample;
+};
+
+int main(int argc, char **argv)
+{
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+    const uint16_t compressions[] = {20, 50, 100, 200};
+    const double quantiles[] = {0.5, 0.9, 0.99};
+
+    // Brew durations in ms: a tight normal around one drink size, a mix of two drink sizes and a long tail
+    std::normal_distribution<double> single(25000, 1500);
+    std::normal_distribution<double> doppio(40000, 2000);
+    std::lognormal_distribution<double> tail(10, 0.4);
+    std::bernoulli_distribution coin(0.3);
+    std::vector<Distribution> distributions = {
+        {"normal", [&](std::mt19937 &rng) { return single(rng); }},
+        {"bimodal", [&](std::mt19937 &rng) { return coin(rng) ? doppio(rng) : single(rng); }},
+        {"lognormal", [&](std::mt19937 &rng) { return tail(rng); }},
+    };
+
+    printf("%-10s %11s %8s %12s", "dist", "compression", "bytes", "ns/insert");
+    for (double q : quantiles)
+    {
+        printf("  rank_err@%.2f", q);
+    }
+    printf("\n");
+
+    for (const Distribution &distribution : distributions)
+    {
+        std::mt19937 rng(42);
+        std::vector<double> values(n);
+        for (double &value : values)
+        {
+            value = distribution.sample(rng);
+        }
+        std::vector<double> sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+
+        for (uint16_t compression : compressions)
+        {
+            QuantileSketch sketch(compression);
+            auto start = std::chrono::steady_clock::now();
+            for (double value : values)
+            {
+                sketch.add(value);
+            }
+            // the final compress is part of the insert cost
+            sketch.quantile(0.5);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+            printf("%-10s %11u %8zu %12.1f", distribution.name, compression, sketch.memoryBytes(), ns / n);
+            for (double q : quantiles)
+            {
+                double estimate = sketch.quantile(q);
+                double rank = (std::lower_bound(sorted.begin(), sorted.end(), estimate) - sorted.begin()) / (double)n;
+                printf("  %13.5f", rank - q);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
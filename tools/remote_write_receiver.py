@@ -0,0 +1,341 @@
+#!/usr/bin/env python3
+"""Local stand-in for a Remote Write endpoint, for the on-prem fan-out and for tools/fleet_sim.
+
+Point ONPREM_URL in include/config.h to the machine running this script, set ONPREM_PORT to the port and run:
+
+    python3 tools/remote_write_receiver.py --port 8080 --verbose
+
+Every push is decompressed, decoded (Remote Write 1.0 or 2.0) and validated: all series need a name, job and
+instance, timestamps must increase and histogram buckets must not decrease with le. The receiver reports
+throughput, handling latency, sample delay and how synchronized the pushes are: per push interval, the phase
+coherence of all push times, 0 if they are spread evenly and 1 if all devices push at the same moment.
+Requests from tools/fleet_sim carry their simulated send time, which is used instead of the wall clock.
+--delay and --status simulate a slow or failing endpoint.
+"""
+
+import argparse
+import math
+import signal
+import struct
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+
+def read_varint(data, pos):
+    value = shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if byte < 0x80:
+            return value, pos
+
+
+def snappy_decompress(data):
+    length, pos = read_varint(data, 0)
+    out = bytearray()
+    while pos < len(data):
+        tag = data[pos]
+        pos += 1
+        kind = tag & 3
+        if kind == 0:
+            size = tag >> 2
+            if size >= 60:
+                extra = size - 59
+                size = int.from_bytes(data[pos:pos + extra], "little")
+                pos += extra
+            size += 1
+            out += data[pos:pos + size]
+            pos += size
+            continue
+        if kind == 1:
+            size = ((tag >> 2) & 7) + 4
+            offset = ((tag >> 5) << 8) | data[pos]
+            pos += 1
+        elif kind == 2:
+            size = (tag >> 2) + 1
+            offset = int.from_bytes(data[pos:pos + 2], "little")
+            pos += 2
+        else:
+            size = (tag >> 2) + 1
+            offset = int.from_bytes(data[pos:pos + 4], "little")
+            pos += 4
+        if offset == 0 or offset > len(out):
+            raise ValueError("invalid copy offset")
+        for _ in range(size):
+            out.append(out[-offset])
+    if len(out) != length:
+        raise ValueError("expected %d bytes, got %d" % (length, len(out)))
+    return bytes(out)
+
+
+def fields(message):
+    """Yields (field number, wire type, value) of a protobuf message, length-delimited values as bytes."""
+    pos = 0
+    while pos < len(message):
+        key, pos = read_varint(message, pos)
+        number, wire_type = key >> 3, key & 7
+        if wire_type == 0:
+            value, pos = read_varint(message, pos)
+        elif wire_type == 1:
+            value = message[pos:pos + 8]
+            pos += 8
+        elif wire_type == 2:
+            size, pos = read_varint(message, pos)
+            value = message[pos:pos + size]
+            pos += size
+        elif wire_type == 5:
+            value = message[pos:pos + 4]
+            pos += 4
+        else:
+            raise ValueError("unsupported wire type %d" % wire_type)
+        if pos > len(message):
+            raise ValueError("truncated field %d" % number)
+        yield number, wire_type, value
+
+
+def decode_sample(message):
+    value, timestamp = 0.0, 0
+    for number, wire_type, field in fields(message):
+        if number == 1 and wire_type == 1:
+            value = struct.unpack("<d", field)[0]
+        elif number == 2 and wire_type == 0:
+            timestamp = field
+    return timestamp, value
+
+
+def decode_v1(message):
+    """Decodes a prometheus.WriteRequest into a list of (labels, samples)."""
+    series = []
+    for number, _, ts in fields(message):
+        if number != 1:
+            continue
+        labels, samples = {}, []
+        for ts_number, _, field in fields(ts):
+            if ts_number == 1:
+                label = {n: v.decode() for n, _, v in fields(field)}
+                labels[label.get(1, "")] = label.get(2, "")
+            elif ts_number == 2:
+                samples.append(decode_sample(field))
+        series.append((labels, samples))
+    return series
+
+
+def decode_v2(message):
+    """Decodes an io.prometheus.write.v2.Request into a list of (labels, samples)."""
+    symbols, raw_series = [], []
+    for number, _, field in fields(message):
+        if number == 4:
+            symbols.append(field.decode())
+        elif number == 5:
+            raw_series.append(field)
+    if not symbols or symbols[0] != "":
+        raise ValueError("first symbol must be empty")
+    series = []
+    for ts in raw_series:
+        refs, samples = [], []
+        for number, _, field in fields(ts):
+            if number == 1:
+                pos = 0
+                while pos < len(field):
+                    ref, pos = read_varint(field, pos)
+                    refs.append(ref)
+            elif number == 2:
+                samples.append(decode_sample(field))
+        if len(refs) % 2 or any(ref >= len(symbols) for ref in refs):
+            raise ValueError("invalid label refs")
+        series.append(({symbols[refs[i]]: symbols[refs[i + 1]] for i in range(0, len(refs), 2)}, samples))
+    return series
+
+
+def validate(series):
+    """Returns a list of problems: missing labels, unordered samples and inconsistent histograms."""
+    problems = []
+    histograms = {}
+    for labels, samples in series:
+        name = labels.get("__name__", "")
+        if not name or "job" not in labels or "instance" not in labels:
+            problems.append("series without __name__, job or instance: %s" % labels)
+            continue
+        if not samples:
+            problems.append("%s has no samples" % name)
+        if any(a[0] >= b[0] for a, b in zip(samples, samples[1:])):
+            problems.append("%s has unordered timestamps" % name)
+        if name.endswith("_bucket") or name.endswith("_count"):
+            base = name.rsplit("_", 1)[0]
+            key = (base, tuple(sorted((k, v) for k, v in labels.items() if k not in ("__name__", "le"))))
+            histogram = histograms.setdefault(key, {"buckets": [], "count": None})
+            if name.endswith("_bucket"):
+                histogram["buckets"].append((float(labels.get("le", "nan")), dict(samples)))
+            else:
+                histogram["count"] = dict(samples)
+    for (base, _), histogram in histograms.items():
+        if not histogram["buckets"]:
+            # a summary or a counter named _count
+            continue
+        finite = sorted((b for b in histogram["buckets"] if b[0] != float("inf")), key=lambda b: b[0])
+        infinite = [samples for le, samples in histogram["buckets"] if le == float("inf")]
+        for (_, lower), (le, upper) in zip(finite, finite[1:]):
+            if any(upper.get(t, v) < v for t, v in lower.items()):
+                problems.append("%s bucket le=%g is smaller than the bucket below" % (base, le))
+        if not infinite:
+            problems.append("%s has no le=\"+Inf\" bucket" % base)
+            continue
+        if finite and any(infinite[0].get(t, v) < v for t, v in finite[-1][1].items()):
+            problems.append("%s le=\"+Inf\" bucket is smaller than the largest finite bucket" % base)
+        if histogram["count"] is not None:
+            if any(infinite[0].get(t) != v for t, v in histogram["count"].items()):
+                problems.append("%s le=\"+Inf\" bucket is not _count" % base)
+    return problems
+
+
+def percentile(values, q):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+class Stats:
+    def __init__(self, interval):
+        self.lock = threading.Lock()
+        self.interval = interval
+        self.first = None
+        self.last = None
+        self.requests = 0
+        self.invalid = 0
+        self.bytes = 0
+        self.samples = 0
+        self.handling_ms = []
+        self.delay_s = []
+        self.arrivals = []  # send time of every push, simulated if the sender provides it
+        self.problems = {}
+
+    def record(self, now, send_time_ms, size, series, handling_ms, problems):
+        with self.lock:
+            self.first = self.first or now
+            self.last = now
+            self.requests += 1
+            self.bytes += size
+            self.invalid += bool(problems)
+            for problem in problems:
+                self.problems[problem] = self.problems.get(problem, 0) + 1
+            self.handling_ms.append(handling_ms)
+            self.arrivals.append(send_time_ms)
+            for _, samples in series:
+                self.samples += len(samples)
+                # delay from taking the sample to receiving it
+                self.delay_s.extend((send_time_ms - t) / 1000.0 for t, _ in samples)
+
+    def sync(self):
+        """Phase coherence of the pushes per push interval: 0 if spread evenly, 1 if all devices push at once."""
+        windows = {}
+        for t in self.arrivals:
+            windows.setdefault(int(t // (self.interval * 1000)), []).append(t)
+        result = []
+        for window, times in sorted(windows.items()):
+            phases = [2 * math.pi * (t % (self.interval * 1000)) / (self.interval * 1000) for t in times]
+            r = abs(sum(complex(math.cos(p), math.sin(p)) for p in phases)) / len(phases)
+            result.append((window * self.interval, len(times), r))
+        return result
+
+    def report(self):
+        with self.lock:
+            if not self.requests:
+                return "no requests yet"
+            wall = max(self.last - self.first, 1e-9)
+            lines = [
+                "requests %d (%d invalid), %d samples, %d bytes" % (self.requests, self.invalid, self.samples, self.bytes),
+                "throughput %.1f requests/s, %.0f samples/s" % (self.requests / wall, self.samples / wall),
+                "handling latency p50 %.2f ms, p99 %.2f ms" % (percentile(self.handling_ms, 0.5), percentile(self.handling_ms, 0.99)),
+                "sample delay p50 %.0f s, p99 %.0f s" % (percentile(self.delay_s, 0.5), percentile(self.delay_s, 0.99)),
+            ]
+            per_second = {}
+            for t in self.arrivals:
+                per_second[int(t // 1000)] = per_second.get(int(t // 1000), 0) + 1
+            peak_second, peak = max(per_second.items(), key=lambda item: item[1])
+            span = max(self.arrivals) / 1000.0 - min(self.arrivals) / 1000.0 + 1
+            base = int(min(self.arrivals) // 1000)
+            lines.append("peak %d pushes/s at +%d s, mean %.2f pushes/s" % (peak, peak_second - base, self.requests / span))
+            windows = self.sync()
+            if len(windows) > 2:
+                # the first and last window are partial
+                full = windows[1:-1]
+                median = sorted(r for _, _, r in full)[len(full) // 2]
+                start, pushes, worst = max(full, key=lambda w: w[2])
+                lines.append("sync per %d s window: median %.2f, max %.2f at +%d s (%d pushes)"
+                             % (self.interval, median, worst, start - windows[0][0], pushes))
+            for problem, count in sorted(self.problems.items(), key=lambda item: -item[1])[:10]:
+                lines.append("  %dx %s" % (count, problem))
+            return "\n".join(lines)
+
+
+class Handler(BaseHTTPRequestHandler):
+    delay = 0.0
+    status = 204
+    verbose = False
+    stats = None
+
+    def do_POST(self):
+        start = time.monotonic()
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        version = self.headers.get("X-Prometheus-Remote-Write-Version", "0.1.0")
+        send_time_ms = int(self.headers.get("X-Sim-Time-Ms", time.time() * 1000))
+        try:
+            message = snappy_decompress(body)
+            series = decode_v2(message) if version.startswith("2") else decode_v1(message)
+        except (ValueError, IndexError, UnicodeDecodeError, struct.error) as e:
+            print("%s %s invalid payload: %s" % (time.strftime("%H:%M:%S"), self.path, e))
+            self.stats.record(time.monotonic(), send_time_ms, len(body), [], (time.monotonic() - start) * 1000, ["undecodable payload"])
+            self.send_response(400)
+            self.end_headers()
+            return
+        problems = validate(series)
+        self.stats.record(time.monotonic(), send_time_ms, len(body), series, (time.monotonic() - start) * 1000, problems)
+        if self.verbose:
+            print("%s %s v%s %d bytes, %d uncompressed, %d series%s" % (time.strftime("%H:%M:%S"), self.path, version, len(body), len(message),
+                                                                          len(series), ", %d problems" % len(problems) if problems else ""))
+        time.sleep(self.delay)
+        self.send_response(self.status)
+        self.end_headers()
+
+    def log_message(self, format, *args):
+        pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--delay", type=float, default=0.0, help="seconds to wait before answering")
+    parser.add_argument("--status", type=int, default=204, help="HTTP status to answer with, e.g. 415 or 503")
+    parser.add_argument("--interval", type=int, default=180, help="push interval of the devices in seconds, REMOTE_WRITE_INTERVAL_SECONDS")
+    parser.add_argument("--report", type=float, default=10, help="seconds between reports, 0 to report on exit only")
+    parser.add_argument("--verbose", action="store_true", help="print every push")
+    args = parser.parse_args()
+    Handler.delay = args.delay
+    Handler.status = args.status
+    Handler.verbose = args.verbose
+    Handler.stats = Stats(args.interval)
+    server = ThreadingHTTPServer(("", args.port), Handler)
+    server.daemon_threads = True
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+    print("listening on port %d" % args.port)
+    # also report when stopped with kill, e.g. from a script
+    signal.signal(signal.SIGTERM, signal.default_int_handler)
+    try:
+        while True:
+            time.sleep(args.report or 3600)
+            if args.report:
+                print(Handler.stats.report(), flush=True)
+    except KeyboardInterrupt:
+        pass
+    server.shutdown()
+    print(Handler.stats.report())
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,284 @@
+// Compares the payload size of Remote Write 1.0 (prometheus.WriteRequest) and 2.0
+// (io.prometheus.write.v2.Request) for the series pushed by the firmware, before and after snappy.
+//
+// Build and run from the repository root:
+//   g++ -std=c++17 -O2 -Iinclude tools/remote_write_size/remote_write_size.cpp src/remote_write_encoder.cpp src/remote_write_v1.cpp src/remote_write_v2.cpp -o remote_write_size
+//   ./remote_write_size [samples per series]
+//
+// Both payloads are built by the encoders of the firmware and compressed with the minimal snappy compressor
+// in tools/common, so compressed sizes are close to, but not byte-identical with, the output of snappy on the
+// device. Both payloads are decoded again to check that the encoders round-trip.
+
+#include "remote_write_v1.h"
+#include "remote_write_v2.h"
+#include "../common/snappy_block.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+struct Series
+{
+    std::string name;
+    std::string labels;
+};
+
+// ---- protobuf helpers ----
+
+static bool getVarint(const std::string &in, size_t &pos, uint64_t &value)
+{
+    value = 0;
+    for (int shift = 0; pos < in.size() && shift < 64; shift += 7)
+    {
+        uint8_t byte = in[pos++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// ---- Remote Write 1.0 decoding for the round-trip check ----
+
+static bool checkV1(const std::string &in, const std::vector<Series> &series, int count)
+{
+    size_t pos = 0;
+    size_t index = 0;
+    while (pos < in.size())
+    {
+        uint64_t tag, len;
+        if (!getVarint(in, pos, tag) || tag != 0x0a || !getVarint(in, pos, len) || pos + len > in.size() || index >= series.size())
+            return false;
+        std::string field = in.substr(pos, len);
+        pos += len;
+
+        std::string name;
+        std::string previous_key;
+        int labels = 0;
+        int samples = 0;
+        size_t p = 0;
+        while (p < field.size())
+        {
+            uint64_t t, l;
+            if (!getVarint(field, p, t) || !getVarint(field, p, l) || p + l > field.size())
+                return false;
+            std::string message = field.substr(p, l);
+            p += l;
+            if (t == 0x12)
+            {
+                samples++;
+                continue;
+            }
+            if (t != 0x0a)
+                return false;
+            // Label: name = 1, value = 2
+            size_t q = 0;
+            std::string key, value;
+            while (q < message.size())
+            {
+                uint64_t lt, ll;
+                if (!getVarint(message, q, lt) || !getVarint(message, q, ll) || q + ll > message.size())
+                    return false;
+                (lt == 0x0a ? key : value) = message.substr(q, ll);
+                q += ll;
+            }
+            if (labels > 0 && key <= previous_key)
+                return false;
+            previous_key = key;
+            labels++;
+            if (key == "__name__")
+                name = value;
+            else if (series[index].labels.find(key + "=\"" + value + "\"") == std::string::npos)
+                return false;
+        }
+        if (name != series[index].name || samples != count)
+            return false;
+        index++;
+    }
+    return index == series.size();
+}
+
+// ---- Remote Write 2.0 decoding for the round-trip check ----
+
+static bool checkV2(const std::string &in, const std::vector<Series> &series, int count)
+{
+    std::vector<std::string> symbols;
+    std::vector<std::vector<uint32_t>> refs;
+    std::vector<int> sample_counts;
+    size_t pos = 0;
+    while (pos < in.size())
+    {
+        uint64_t tag, len;
+        if (!getVarint(in, pos, tag) || !getVarint(in, pos, len) || pos + len > in.size())
+            return false;
+        std::string field = in.substr(pos, len);
+        pos += len;
+        if (tag == 0x22)
+        {
+            symbols.push_back(field);
+            continue;
+        }
+        if (tag != 0x2a)
+            return false;
+        refs.emplace_back();
+        sample_counts.push_back(0);
+        size_t p = 0;
+        while (p < field.size())
+        {
+            uint64_t t, l;
+            if (!getVarint(field, p, t) || !getVarint(field, p, l))
+                return false;
+            if (t == 0x0a)
+            {
+                size_t end = p + l;
+                while (p < end)
+                {
+                    uint64_t ref;
+                    getVarint(field, p, ref);
+                    refs.back().push_back(ref);
+                }
+            }
+            else
+            {
+                sample_counts.back()++;
+                p += l;
+            }
+        }
+    }
+    if (symbols.empty() || !symbols[0].empty() || refs.size() != series.size())
+        return false;
+    for (size_t s = 0; s < series.size(); s++)
+    {
+        std::string labels = "{";
+        std::string name;
+        for (size_t i = 0; i + 1 < refs[s].size(); i += 2)
+        {
+            if (refs[s][i + 1] >= symbols.size())
+                return false;
+            const std::string &key = symbols[refs[s][i]];
+            const std::string &value = symbols[refs[s][i + 1]];
+            if (key == "__name__")
+                name = value;
+            else if (series[s].labels.find(key + "=\"" + value + "\"") == std::string::npos)
+                return false;
+        }
+        if (name != series[s].name || sample_counts[s] != count)
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 10;
+    if (count <= 0)
+    {
+        fprintf(stderr, "usage: %s [samples per series]\n", argv[0]);
+        return 1;
+    }
+
+    // The series pushed by src/main.cpp with ENABLE_REV2_SENSORS
+    const std::string labels = "{job=\"cmi_coffee_counter\",instance=\"0000A1B2C3D4\",site=\"zurich\",floor=\"3\"}";
+    std::vector<Series> series;
+    for (const char *gauge : {"ESP32_system_memory_total_bytes", "ESP32_system_run_time_ms", "ESP32_system_remote_write_failures_count",
+                              "ESP32_system_cpu_clock_mhz", "ESP32_system_wifi_fast_connect_failures_count", "ESP32_system_log_dropped_messages_count",
+                              "ESP32_system_memory_pressure_transitions_count", "coffee_counter_temperature", "coffee_counter_humidity"})
+    {
+        series.push_back({gauge, labels});
+    }
+    for (const char *gauge : {"ESP32_system_memory_free_bytes", "ESP32_system_network_wifi_rssi", "ESP32_system_largest_heap_block_size_bytes",
+                              "ESP32_system_cpu_temperature_celsius", "ESP32_system_memory_pressure_stage"})
+    {
+        for (const char *suffix : {"", "_min", "_max", "_avg"})
+        {
+            series.push_back({std::string(gauge) + suffix, labels});
+        }
+    }
+    auto addHistogram = [&](const std::string &name, int start, int increment, int buckets, const std::string &histogram_labels)
+    {
+        for (int i = 0; i <= buckets; i++)
+        {
+            std::string le = i == buckets ? "+Inf" : std::to_string(start + i * increment);
+            series.push_back({name + "_bucket", histogram_labels.substr(0, histogram_labels.size() - 1) + ",le=\"" + le + "\"}"});
+        }
+        series.push_back({name + "_count", histogram_labels});
+        series.push_back({name + "_sum", histogram_labels});
+    };
+    addHistogram("CMI_coffees_consumed", 12000, 4000, 10, labels);
+    for (const char *q : {"0.5", "0.9", "0.99"})
+    {
+        series.push_back({"CMI_coffee_brew_duration_ms", labels.substr(0, labels.size() - 1) + ",quantile=\"" + q + "\"}"});
+    }
+    series.push_back({"CMI_coffee_brew_duration_ms_count", labels});
+    series.push_back({"CMI_coffee_brew_duration_ms_sum", labels});
+    addHistogram("ESP32_system_wifi_connect_duration_ms", 500, 1000, 5, labels);
+    // one send duration histogram per endpoint, only Grafana Cloud by default
+    addHistogram("ESP32_system_remote_write_send_duration_ms", 500, 1000, 4, labels.substr(0, labels.size() - 1) + ",endpoint=\"grafana_cloud\"}");
+
+    // One sample per minute with plausible values
+    std::vector<int64_t> timestamps(count);
+    std::vector<double> values(count);
+    for (int i = 0; i < count; i++)
+    {
+        timestamps[i] = 1760000000000LL + i * 60000LL;
+        values[i] = 123456 - i * 17;
+    }
+
+    // sized like the firmware's, see MetricRegistry::maxEncodedSize(), so an encoding failure means the bound is wrong
+    size_t buffer_size = 2;
+    for (const Series &s : series)
+    {
+        buffer_size += RemoteWriteEncoder::maxSeriesSize(s.name.c_str(), s.labels.c_str(), count);
+    }
+    RemoteWriteV1Encoder encoder_v1(buffer_size);
+    for (const Series &s : series)
+    {
+        encoder_v1.addSeries(s.name.c_str(), s.labels.c_str(), timestamps.data(), values.data(), count);
+    }
+    size_t v1_length = encoder_v1.finish();
+    if (v1_length == 0)
+    {
+        fprintf(stderr, "v1 encoding failed: %s\n", encoder_v1.errmsg);
+        return 1;
+    }
+    std::string v1(reinterpret_cast<const char *>(encoder_v1.data()), v1_length);
+    if (!checkV1(v1, series, count))
+    {
+        fprintf(stderr, "v1 round-trip check failed\n");
+        return 1;
+    }
+
+    RemoteWriteV2Encoder encoder(buffer_size, 256);
+    for (const Series &s : series)
+    {
+        if (!encoder.addSeries(s.name.c_str(), s.labels.c_str(), timestamps.data(), values.data(), count))
+        {
+            fprintf(stderr, "v2 encoding failed: %s\n", encoder.errmsg);
+            return 1;
+        }
+    }
+    size_t v2_length = encoder.finish();
+    if (v2_length == 0)
+    {
+        fprintf(stderr, "v2 encoding failed: %s\n", encoder.errmsg);
+        return 1;
+    }
+    std::string v2(reinterpret_cast<const char *>(encoder.data()), v2_length);
+    if (!checkV2(v2, series, count))
+    {
+        fprintf(stderr, "v2 round-trip check failed\n");
+        return 1;
+    }
+
+    size_t v1_snappy = snappyCompress(v1).size();
+    size_t v2_snappy = snappyCompress(v2).size();
+    printf("series %zu, samples per series %d, symbols %u\n", series.size(), count, encoder.symbolCount());
+    printf("%-8s %10s %10s\n", "format", "raw", "snappy");
+    printf("%-8s %10zu %10zu\n", "v1", v1.size(), v1_snappy);
+    printf("%-8s %10zu %10zu\n", "v2", v2.size(), v2_snappy);
+    // largest encode and compression buffers the firmware allocates during a push, see snappy_max_compressed_length()
+    printf("%-8s %10zu %10zu\n", "buffer", buffer_size, 32 + buffer_size + buffer_size / 6);
+    printf("%-8s %9.1f%% %9.1f%%\n", "saved", 100.0 * (1 - (double)v2.size() / v1.size()), 100.0 * (1 - (double)v2_snappy / v1_snappy));
+    return 0;
+}
@@ -0,0 +1,239 @@
+#!/usr/bin/env python3
+"""Decodes the binary telemetry stream of the coffee counter and shows live stats or writes them to files.
+
+Set ENABLE_TELEMETRY in include/config.h and flash, then read from the CP2102N:
+
+    python3 tools/telemetry_decoder.py --port /dev/ttyUSB0
+    python3 tools/telemetry_decoder.py --port /dev/ttyUSB0 --csv out/ --raw capture.bin
+
+or decode a capture saved with --raw (or any other tool) later, '-' reads stdin:
+
+    python3 tools/telemetry_decoder.py capture.bin --csv out/
+
+Reading from a serial port needs pyserial (pip install pyserial).
+"""
+
+import argparse
+import binascii
+import csv
+import os
+import struct
+import sys
+import time
+
+# Keep in sync with include/telemetry.h
+NAME, HISTOGRAM, GAUGE, EVENT, TEXT, STATS = range(1, 7)
+KINDS = {1: "histogram", 2: "gauge"}
+EVENTS = {1: "vibration_edge", 2: "coffee", 3: "wifi_connected", 4: "wifi_disconnected", 5: "remote_write", 6: "memory_stage"}
+HEADER = struct.Struct("<BBI")
+
+
+class FrameError(Exception):
+    pass
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0:
+            raise FrameError("zero byte in frame")
+        block = data[i + 1:i + code]
+        if len(block) != code - 1:
+            raise FrameError("truncated COBS block")
+        out += block
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def decode_frame(data):
+    """Returns (type, sequence, timestamp_us, payload) or raises FrameError."""
+    body = cobs_decode(data)
+    if len(body) < HEADER.size + 2:
+        raise FrameError("short frame")
+    # CRC-16/CCITT-FALSE, polynomial 0x1021 and initial value 0xFFFF
+    crc, = struct.unpack_from("<H", body, len(body) - 2)
+    if binascii.crc_hqx(body[:-2], 0xFFFF) != crc:
+        raise FrameError("CRC mismatch")
+    frame_type, sequence, timestamp_us = HEADER.unpack_from(body)
+    return frame_type, sequence, timestamp_us, body[HEADER.size:-2]
+
+
+class Series:
+    def __init__(self):
+        self.count = 0
+        self.last = None
+        self.min = None
+        self.max = None
+        self.sum = 0.0
+
+    def add(self, value):
+        self.count += 1
+        self.last = value
+        self.min = value if self.min is None else min(self.min, value)
+        self.max = value if self.max is None else max(self.max, value)
+        self.sum += value
+
+
+class Decoder:
+    def __init__(self, csv_dir=None, show_text=True):
+        self.names = {}
+        self.series = {}
+        self.events = {}
+        self.frames = 0
+        self.bytes = 0
+        self.invalid = 0
+        self.gaps = 0
+        self.device_dropped = 0
+        self.last_sequence = None
+        self.time_base = 0
+        self.last_timestamp = None
+        self.show_text = show_text
+        self.buffer = bytearray()
+        self.synced = False
+        self.metrics_file = self.events_file = self.text_file = None
+        self.metrics_csv = self.events_csv = None
+        if csv_dir is not None:
+            os.makedirs(csv_dir, exist_ok=True)
+            self.metrics_file = open(os.path.join(csv_dir, "metrics.csv"), "w", newline="")
+            self.events_file = open(os.path.join(csv_dir, "events.csv"), "w", newline="")
+            self.text_file = open(os.path.join(csv_dir, "log.txt"), "w")
+            self.metrics_csv = csv.writer(self.metrics_file)
+            self.events_csv = csv.writer(self.events_file)
+            self.metrics_csv.writerow(["device_time_s", "kind", "name", "value"])
+            self.events_csv.writerow(["device_time_s", "event", "arg"])
+
+    def feed(self, data):
+        self.bytes += len(data)
+        self.buffer += data
+        while True:
+            end = self.buffer.find(0)
+            if end < 0:
+                return
+            frame = bytes(self.buffer[:end])
+            del self.buffer[:end + 1]
+            if not frame:
+                continue
+            try:
+                self.handle(*decode_frame(frame))
+                self.synced = True
+            except (FrameError, struct.error):
+                # reading may start in the middle of a frame or boot messages, only count errors once in sync
+                if self.synced:
+                    self.invalid += 1
+
+    def device_time(self, timestamp_us):
+        # 32 bit microsecond counter, wraps after ~71 minutes
+        if self.last_timestamp is not None and timestamp_us < self.last_timestamp and self.last_timestamp - timestamp_us > 1 << 31:
+            self.time_base += 1 << 32
+        self.last_timestamp = timestamp_us
+        return (self.time_base + timestamp_us) / 1e6
+
+    def handle(self, frame_type, sequence, timestamp_us, payload):
+        self.frames += 1
+        if self.last_sequence is not None:
+            self.gaps += (sequence - self.last_sequence - 1) & 0xFF
+        self.last_sequence = sequence
+        t = self.device_time(timestamp_us)
+
+        if frame_type == NAME:
+            metric_id, kind = struct.unpack_from("<HB", payload)
+            self.names[metric_id] = (KINDS.get(kind, str(kind)), payload[3:].decode(errors="replace"))
+        elif frame_type in (HISTOGRAM, GAUGE):
+            metric_id, value = struct.unpack_from("<Hq" if frame_type == HISTOGRAM else "<Hd", payload)
+            kind, name = self.names.get(metric_id, (KINDS[frame_type - 1], "id%d" % metric_id))
+            self.series.setdefault((kind, name), Series()).add(value)
+            if self.metrics_csv:
+                self.metrics_csv.writerow(["%.6f" % t, kind, name, value])
+        elif frame_type == EVENT:
+            event, arg = struct.unpack_from("<Hq", payload)
+            name = EVENTS.get(event, "event%d" % event)
+            self.events.setdefault(name, Series()).add(arg)
+            if self.events_csv:
+                self.events_csv.writerow(["%.6f" % t, name, arg])
+        elif frame_type == TEXT:
+            line = payload.decode(errors="replace")
+            if self.text_file:
+                # without timestamps, so trace dumps can be passed to trace_to_chrome.py
+                self.text_file.write(line + "\n")
+            if self.show_text:
+                print("%10.3f %s" % (t, line))
+        elif frame_type == STATS:
+            self.device_dropped, = struct.unpack_from("<I", payload)
+
+    def report(self, elapsed, out=sys.stdout):
+        rate = lambda n: n / elapsed if elapsed > 0 else 0.0
+        out.write("-- %d frames (%.0f/s), %d bytes (%.0f/s), %d invalid, %d sequence gaps, %d dropped on device\n" %
+                  (self.frames, rate(self.frames), self.bytes, rate(self.bytes), self.invalid, self.gaps, self.device_dropped))
+        for (kind, name), s in sorted(self.series.items(), key=lambda item: item[0][1]):
+            out.write("   %-9s %-50s n=%-6d last=%-10.6g min=%-10.6g max=%-10.6g avg=%.6g\n" %
+                      (kind, name, s.count, s.last, s.min, s.max, s.sum / s.count))
+        for name, s in sorted(self.events.items()):
+            out.write("   %-9s %-50s n=%-6d last=%d\n" % ("event", name, s.count, s.last))
+        out.flush()
+
+    def close(self):
+        for f in (self.metrics_file, self.events_file, self.text_file):
+            if f:
+                f.close()
+
+
+def open_input(args):
+    if args.port:
+        try:
+            import serial
+        except ImportError:
+            sys.exit("reading from a serial port needs pyserial: pip install pyserial")
+        port = serial.Serial(args.port, args.baud, timeout=0.1)
+        if args.trace:
+            # requests a trace dump if the firmware is built with ENABLE_TRACE
+            port.write(b"t")
+        return lambda: port.read(4096)
+    stream = sys.stdin.buffer if args.input == "-" else open(args.input, "rb")
+    return lambda: stream.read1(4096) if hasattr(stream, "read1") else stream.read(4096)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", nargs="?", help="capture file, '-' for stdin")
+    parser.add_argument("--port", help="serial port, e.g. /dev/ttyUSB0")
+    parser.add_argument("--baud", type=int, default=921600, help="TELEMETRY_BAUD of the firmware")
+    parser.add_argument("--csv", metavar="DIR", help="write metrics.csv, events.csv and log.txt to DIR")
+    parser.add_argument("--raw", metavar="FILE", help="save the received bytes for decoding later")
+    parser.add_argument("--interval", type=float, default=5, help="seconds between live stats, 0 to only print them at the end")
+    parser.add_argument("--trace", action="store_true", help="request a trace dump after opening the port")
+    parser.add_argument("--quiet", action="store_true", help="do not print log lines")
+    args = parser.parse_args()
+    if (args.port is None) == (args.input is None):
+        parser.error("give either a capture file or --port")
+
+    read = open_input(args)
+    raw = open(args.raw, "wb") if args.raw else None
+    decoder = Decoder(args.csv, not args.quiet)
+    start = last_report = time.monotonic()
+    try:
+        while True:
+            data = read()
+            if not data and not args.port:
+                break
+            if raw:
+                raw.write(data)
+            decoder.feed(data)
+            now = time.monotonic()
+            if args.interval > 0 and now - last_report >= args.interval:
+                decoder.report(now - start)
+                last_report = now
+    except KeyboardInterrupt:
+        pass
+    finally:
+        decoder.report(time.monotonic() - start)
+        decoder.close()
+        if raw:
+            raw.close()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Converts a trace dump captured from the serial monitor into Chrome trace JSON.
+
+Enable ENABLE_TRACE in include/config.h, send 't' over serial and save the output, then run:
+
+    python3 tools/trace_to_chrome.py serial.log trace.json
+
+Open the result in chrome://tracing or https://ui.perfetto.dev.
+"""
+
+import json
+import struct
+import sys
+
+# Keep in sync with include/trace.h
+RECORD = struct.Struct("<IIBBH")
+TASK_BEGIN, TASK_END, SEM_WAIT, SEM_ACQUIRED, SEM_RELEASED, GPIO_EDGE, SEND_BEGIN, SEND_END, VALUE = range(1, 10)
+SPANS = {0: "main loop", 1: "vibration detect", 2: "transport connect", 3: "histogram ingest"}
+SEMAPHORES = {0: "update_sem", 1: "Transport::semaphore", 2: "summary update_sem"}
+
+
+def parse(lines):
+    records = []
+    tasks = {}
+    cost = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("TR "):
+            records.append(RECORD.unpack(bytes.fromhex(line[3:])))
+        elif line.startswith("TRACE_TASK "):
+            _, handle, name = line.split(" ", 2)
+            tasks[int(handle, 16)] = name
+        elif line.startswith("TRACE_COST "):
+            cost = line[len("TRACE_COST "):]
+    return records, tasks, cost
+
+
+def convert(records, tasks):
+    events = []
+    waiting = {}
+    base = None
+    last = None
+    for ts, task, event, core, arg in records:
+        # the device timestamp is a 32 bit microsecond counter which wraps after ~71 minutes
+        if base is None:
+            base = ts
+            last = ts
+        if ts < last:
+            base -= 1 << 32
+        last = ts
+        # tasks are not pinned, so the core is attached as an argument instead of being used as process id
+        common = {"ts": ts - base, "pid": 0, "tid": task, "args": {"core": core}}
+
+        if event in (TASK_BEGIN, TASK_END):
+            events.append(dict(common, ph="B" if event == TASK_BEGIN else "E", name=SPANS.get(arg, "span %d" % arg)))
+        elif event == SEM_WAIT:
+            key = (task, arg)
+            if key in waiting:
+                # the previous wait timed out
+                events.append(dict(common, ph="E", name="wait " + SEMAPHORES.get(arg, str(arg))))
+            waiting[key] = True
+            events.append(dict(common, ph="B", name="wait " + SEMAPHORES.get(arg, str(arg))))
+        elif event == SEM_ACQUIRED:
+            name = SEMAPHORES.get(arg, str(arg))
+            if waiting.pop((task, arg), None):
+                events.append(dict(common, ph="E", name="wait " + name))
+            events.append(dict(common, ph="B", name="hold " + name))
+        elif event == SEM_RELEASED:
+            events.append(dict(common, ph="E", name="hold " + SEMAPHORES.get(arg, str(arg))))
+        elif event == GPIO_EDGE:
+            events.append(dict(common, ph="C", name="gpio %d" % (arg >> 1), args={"level": arg & 1}))
+        elif event == SEND_BEGIN:
+            events.append(dict(common, ph="B", name="send"))
+        elif event == SEND_END:
+            events.append(dict(common, ph="E", name="send", args={"result": arg, "core": core}))
+        elif event == VALUE:
+            events.append(dict(common, ph="i", s="t", name="value", args={"value": arg, "core": core}))
+
+    events.append({"ph": "M", "pid": 0, "name": "process_name", "args": {"name": "coffee counter"}})
+    for handle, name in tasks.items():
+        events.append({"ph": "M", "pid": 0, "tid": handle, "name": "thread_name", "args": {"name": name}})
+    return {"traceEvents": events, "displayTimeUnit": "ms"}
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: %s <serial log> <trace.json>" % sys.argv[0])
+        return 1
+    with open(sys.argv[1], errors="replace") as f:
+        records, tasks, cost = parse(f)
+    with open(sys.argv[2], "w") as f:
+        json.dump(convert(records, tasks), f)
+    print("converted %d records" % len(records))
+    if cost is not None:
+        print("recording cost: %s" % cost)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
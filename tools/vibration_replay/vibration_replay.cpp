@@ -0,0 +1,165 @@
+// Replays recorded vibration sensor edge timelines through VibrationDetector and Prometheus_Histogram on the host.
+//
+// Record traces on the device by setting ENABLE_VIBRATION_RECORDING in include/config.h and saving the
+// serial output. Lines not starting with "VR " are ignored, so raw serial logs can be used directly.
+//
+// Build and run from the repository root, on the FreeRTOS shim of tools/freertos_posix:
+//   g++ -std=gnu++17 -O2 -Itools/freertos_posix/include -Iinclude tools/vibration_replay/vibration_replay.cpp tools/freertos_posix/freertos_posix.cpp src/vibration_detector.cpp src/prometheus_histogram.cpp src/metric_series.cpp src/remote_write_encoder.cpp src/log.cpp src/trace.cpp src/telemetry.cpp -o vibration_replay
+//   ./vibration_replay [--threshold-ms N] [--poll-ms N] [--bucket-start N] [--bucket-increment N] [--bucket-count N] trace.log...
+//
+// The sensor is sampled on a simulated clock at the poll interval of the firmware, so a trace replays
+// much faster than real time. Per-event decisions are printed as CSV, followed by the series of the resulting
+// histogram as the firmware would push them.
+
+#include "config.h"
+#include "vibration_detector.h"
+#include "prometheus_histogram.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct Edge
+{
+    int64_t time_ms;
+    bool vibrating;
+};
+
+static std::vector<Edge> readTrace(const char *path)
+{
+    std::vector<Edge> edges;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.compare(0, 3, "VR ") != 0)
+        {
+            continue;
+        }
+        std::istringstream fields(line.substr(3));
+        long long time_ms;
+        int level;
+        if (fields >> time_ms >> level)
+        {
+            edges.push_back({time_ms, level != 0});
+        }
+    }
+    return edges;
+}
+
+/// @brief Prints the last sample of every series in the Prometheus text format instead of encoding it.
+class TextEncoder : public RemoteWriteEncoder
+{
+public:
+    TextEncoder() : RemoteWriteEncoder((size_t)0) {}
+    bool addSeries(const char *name, const char *labels, const int64_t *timestamps, const double *values, uint16_t count) override
+    {
+        printf("%s%s %.0f\n", name, labels, values[count - 1]);
+        return true;
+    }
+    uint8_t remoteWriteVersion() override { return 1; }
+};
+
+int main(int argc, char **argv)
+{
+    int32_t threshold_ms = MOTION_DETECTION_DURATION_THREASHOLD_SECONDS * 1000;
+    int64_t poll_ms = VIBRATION_POLL_INTERVAL_MS;
+    // Same layout as CMI_coffees_consumed in main.cpp
+    int64_t bucket_start = 12000;
+    int64_t bucket_increment = 4000;
+    int bucket_count = 10;
+    std::vector<const char *> traces;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && strcmp(argv[i], "--threshold-ms") == 0)
+            threshold_ms = atoi(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--poll-ms") == 0)
+            poll_ms = atoll(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--bucket-start") == 0)
+            bucket_start = atoll(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--bucket-increment") == 0)
+            bucket_increment = atoll(argv[++i]);
+        else if (i + 1 < argc && strcmp(argv[i], "--bucket-count") == 0)
+            bucket_count = atoi(argv[++i]);
+        else
+            traces.push_back(argv[i]);
+    }
+    // Prometheus_Histogram takes the bucket layout as int16_t
+    bool layout_valid = bucket_start >= 0 && bucket_start <= INT16_MAX && bucket_increment > 0 && bucket_increment <= INT16_MAX &&
+                        bucket_count > 0 && bucket_count < INT16_MAX;
+    if (traces.empty() || poll_ms <= 0 || !layout_valid)
+    {
+        fprintf(stderr, "usage: %s [--threshold-ms N] [--poll-ms N] [--bucket-start N] [--bucket-increment N] [--bucket-count N] trace.log...\n", argv[0]);
+        return 1;
+    }
+
+    Prometheus_Histogram histogram("CMI_coffees_consumed", "{job=\"vibration_replay\"}", 1, bucket_start, bucket_increment, bucket_count);
+    histogram.init();
+    int64_t ignored = 0;
+    int64_t simulated_ms = 0;
+    int64_t polls = 0;
+
+    auto wall_start = std::chrono::steady_clock::now();
+    printf("trace,start_ms,duration_ms,counted\n");
+    for (const char *path : traces)
+    {
+        std::vector<Edge> edges = readTrace(path);
+        if (edges.empty())
+        {
+            fprintf(stderr, "%s: no VR lines found\n", path);
+            continue;
+        }
+
+        VibrationDetector detector(threshold_ms);
+        size_t next_edge = 0;
+        bool vibrating = false;
+        int64_t start_ms = edges.front().time_ms;
+        // poll one interval past the last edge so a trailing vibration is finished
+        int64_t end_ms = edges.back().time_ms + poll_ms;
+        for (int64_t now_ms = start_ms; now_ms <= end_ms; now_ms += poll_ms)
+        {
+            while (next_edge < edges.size() && edges[next_edge].time_ms <= now_ms)
+            {
+                vibrating = edges[next_edge].vibrating;
+                next_edge++;
+            }
+            polls++;
+
+            VibrationEvent event;
+            if (!detector.update(now_ms, vibrating, event))
+            {
+                continue;
+            }
+            printf("%s,%lld,%lld,%d\n", path, (long long)event.start_ms, (long long)event.duration_ms, event.counted ? 1 : 0);
+            if (!event.counted)
+            {
+                ignored++;
+                continue;
+            }
+            histogram.AddValue(event.duration_ms);
+        }
+        simulated_ms += end_ms - start_ms;
+    }
+    double wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+
+    printf("\n# histogram\n");
+    histogram.Ingest(simulated_ms);
+    TextEncoder encoder;
+    histogram.encode(encoder);
+    printf("ignored %lld\n", (long long)ignored);
+
+    printf("\n# replay\n");
+    printf("polls %lld\nsimulated_s %.1f\nwall_ms %.3f\n", (long long)polls, simulated_ms / 1000.0, wall_ms);
+    if (wall_ms > 0)
+    {
+        printf("speedup %.0fx\n", simulated_ms / wall_ms);
+    }
+    return 0;
+}